@@ -0,0 +1,82 @@
+#include <hulaloop/acceptor.h>
+#include <hulaloop/repeater.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+// connection storm against a port shared by several loops via SO_REUSEPORT.
+// usage: accept_storm [loops] [connections] [client threads]
+int main(int argc, char** argv) {
+  const int loops = argc > 1 ? std::atoi(argv[1]) : 1;
+  const int connections = argc > 2 ? std::atoi(argv[2]) : 20000;
+  const int clients = argc > 3 ? std::atoi(argv[3]) : 4;
+
+  std::atomic<int> accepted = 0;
+  std::atomic<uint16_t> port = 0;
+  std::atomic<int> ready = 0;
+  std::atomic<bool> done = false;
+
+  std::vector<std::thread> servers;
+  for (int i = 0; i < loops; ++i) {
+    servers.emplace_back([&] {
+      hula::loop loop;
+      loop.set_poll_interval(0s);
+
+      hula::acceptor acceptor(
+          loop,
+          [&](std::span<const hula::accepted_connection> conns) {
+            for (const auto& c : conns) ::close(c.fd);
+            accepted += conns.size();
+          },
+          {.reuse_port = true});
+
+      // the first loop picks the port, the rest share it
+      while (ready.load() != 0 && port.load() == 0) std::this_thread::yield();
+      acceptor.listen("127.0.0.1", port.load());
+      port = acceptor.port();
+      ready++;
+
+      hula::repeater check(loop, 1ms, [&] {
+        if (done) loop.stop();
+      });
+      check.start();
+      loop.run();
+    });
+    while (ready.load() <= i) std::this_thread::yield();
+  }
+
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port.load());
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  auto start = std::chrono::steady_clock::now();
+
+  std::vector<std::thread> workers;
+  for (int i = 0; i < clients; ++i) {
+    workers.emplace_back([&, i] {
+      for (int n = i; n < connections; n += clients) {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)))
+          std::perror("connect");
+        ::close(fd);
+      }
+    });
+  }
+  for (auto& w : workers) w.join();
+  while (accepted.load() < connections) std::this_thread::yield();
+
+  auto elapsed = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+  done = true;
+  for (auto& s : servers) s.join();
+
+  std::printf("loops=%d connections=%d elapsed=%.3fs rate=%.0f/s\n", loops,
+              connections, elapsed, connections / elapsed);
+  return 0;
+}
@@ -0,0 +1,161 @@
+#include <hulaloop/acceptor.h>
+#include <hulaloop/unix_sig.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+// echoes everything it reads, buffering what the socket won't take yet
+class echo_connection {
+ public:
+  echo_connection(hula::loop<>& loop, int fd,
+                  std::unordered_map<int, std::unique_ptr<echo_connection>>&
+                      connections)
+      : _loop(loop), _fd(fd), _connections(connections) {
+    _closer = _loop.add_fd(_fd,
+                           hula::fd_slots{
+                               .readable = [this](int) { on_readable(); },
+                               .writable = [this](int) { flush(); },
+                               .error = [this](int) { close(); },
+                           },
+                           hula::fd_events::read);
+  }
+
+  ~echo_connection() {
+    _closer.close();
+    ::close(_fd);
+  }
+
+ private:
+  void on_readable() {
+    char buf[64 * 1024];
+    for (;;) {
+      auto n = ::read(_fd, buf, sizeof(buf));
+      if (n == 0) return close();
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN) close();
+        return;
+      }
+      _out.insert(_out.end(), buf, buf + n);
+      if (!flush() || static_cast<size_t>(n) < sizeof(buf)) return;
+    }
+  }
+
+  // returns false once the connection is closed
+  bool flush() {
+    while (_offset < _out.size()) {
+      // a peer which went away fails with EPIPE instead of raising SIGPIPE
+      auto n = ::send(_fd, _out.data() + _offset, _out.size() - _offset,
+                      MSG_NOSIGNAL);
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN) break;
+        close();
+        return false;
+      }
+      _offset += n;
+    }
+    if (_offset == _out.size()) {
+      _out.clear();
+      _offset = 0;
+    }
+    _loop.update_fd(_fd, _out.empty() ? hula::fd_events::read
+                                      : hula::fd_events::read_write);
+    return true;
+  }
+
+  // deferred, this is called from the connection's own slots
+  void close() {
+    _closer.close();
+    _loop.post([&connections = _connections, fd = _fd] {
+      connections.erase(fd);
+    });
+  }
+
+  hula::loop<>& _loop;
+  int _fd;
+  std::unordered_map<int, std::unique_ptr<echo_connection>>& _connections;
+  hula::closer _closer;
+  std::vector<char> _out;
+  size_t _offset = 0;
+};
+
+}  // namespace
+
+// echo server for hula_loadgen. the poll interval is the loop's default
+// unless given, 0 busy polls.
+// usage: echo_server [tcp|unix] [port|path] [poll interval us]
+int main(int argc, char** argv) {
+  const std::string transport = argc > 1 ? argv[1] : "tcp";
+  const std::string where = argc > 2 ? argv[2] : "9000";
+  std::optional<std::chrono::microseconds> poll_interval;
+  if (argc > 3) poll_interval = std::chrono::microseconds(std::atoi(argv[3]));
+
+  hula::loop loop;
+  if (poll_interval) {
+    loop.set_poll_interval(*poll_interval);
+    if (poll_interval->count() == 0 &&
+        std::thread::hardware_concurrency() < 2) {
+      std::fprintf(stderr,
+                   "warning: busy polling on fewer than 2 cores, the server "
+                   "and the load generator will compete for the cpu\n");
+    }
+  }
+
+  std::unordered_map<int, std::unique_ptr<echo_connection>> connections;
+  hula::acceptor acceptor(
+      loop, [&](std::span<const hula::accepted_connection> conns) {
+        for (const auto& c : conns) {
+          if (transport == "tcp") {
+            int one = 1;
+            ::setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+          }
+          connections[c.fd] =
+              std::make_unique<echo_connection>(loop, c.fd, connections);
+        }
+      });
+
+  if (transport == "unix") {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, where.c_str(), sizeof(addr.sun_path) - 1);
+    ::unlink(where.c_str());
+    acceptor.listen(reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+  } else {
+    auto port = static_cast<uint16_t>(std::atoi(where.c_str()));
+    acceptor.listen("127.0.0.1", port);
+  }
+  const std::string interval =
+      poll_interval ? std::to_string(poll_interval->count()) + "us"
+                    : std::string("default");
+  std::printf("echo_server listening on %s %s, poll interval %s\n",
+              transport.c_str(), where.c_str(), interval.c_str());
+
+  auto on_sigint = loop.connect_to_unix_signal(hula::unix::sig::sigint,
+                                               [&] { loop.stop(); });
+  auto on_sigterm = loop.connect_to_unix_signal(hula::unix::sig::sigterm,
+                                                [&] { loop.stop(); });
+  loop.run();
+
+  acceptor.close();
+  connections.clear();
+  if (transport == "unix") ::unlink(where.c_str());
+  return 0;
+}
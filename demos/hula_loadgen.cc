@@ -0,0 +1,273 @@
+#include <hulaloop/histogram.h>
+#include <hulaloop/loop.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std::chrono_literals;
+using clock_type = std::chrono::steady_clock;
+
+namespace {
+
+int connect_to(const std::string& transport, const std::string& where) {
+  int fd = -1;
+  int res = -1;
+  if (transport == "unix") {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, where.c_str(), sizeof(addr.sun_path) - 1);
+    fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    res = ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+  } else {
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(std::atoi(where.c_str())));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    res = ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    int one = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+  if (res != 0) {
+    std::perror("connect");
+    std::exit(1);
+  }
+  ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+  return fd;
+}
+
+struct results {
+  // from when each request should have been sent, which includes any time
+  // the generator itself fell behind (coordinated omission)
+  hula::histogram latency;
+  // from when each request was actually handed to the socket
+  hula::histogram service_time;
+  uint64_t sent = 0;
+  uint64_t completed = 0;
+};
+
+// one connection, with requests in flight answered in order
+class client {
+ public:
+  client(hula::loop<>& loop, int fd, size_t message_size, results& res)
+      : _loop(loop), _fd(fd), _message(message_size, 'x'), _res(res) {
+    _closer = _loop.add_fd(_fd,
+                           hula::fd_slots{
+                               .readable = [this](int) { on_readable(); },
+                               .writable = [this](int) { flush(); },
+                               .error = [this](int) { on_error(); },
+                           },
+                           hula::fd_events::read);
+  }
+
+  ~client() {
+    _closer.close();
+    ::close(_fd);
+  }
+
+  void send(clock_type::time_point intended, clock_type::time_point now) {
+    _intended.push_back(intended);
+    _sent.push_back(now);
+    _out.insert(_out.end(), _message.begin(), _message.end());
+    _res.sent++;
+    flush();
+  }
+
+  size_t in_flight() const { return _intended.size(); }
+
+ private:
+  void flush() {
+    while (_offset < _out.size()) {
+      // a server which went away fails with EPIPE instead of raising SIGPIPE
+      auto n = ::send(_fd, _out.data() + _offset, _out.size() - _offset,
+                      MSG_NOSIGNAL);
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN) break;
+        return on_error();
+      }
+      _offset += n;
+    }
+    if (_offset == _out.size()) {
+      _out.clear();
+      _offset = 0;
+    }
+    bool want_write = !_out.empty();
+    if (want_write != _want_write) {
+      _want_write = want_write;
+      _loop.update_fd(_fd, want_write ? hula::fd_events::read_write
+                                      : hula::fd_events::read);
+    }
+  }
+
+  void on_readable() {
+    char buf[64 * 1024];
+    for (;;) {
+      auto n = ::read(_fd, buf, sizeof(buf));
+      if (n == 0) return on_error();
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN) on_error();
+        return;
+      }
+      complete(static_cast<size_t>(n));
+      if (static_cast<size_t>(n) < sizeof(buf)) return;
+    }
+  }
+
+  // every message_size bytes echoed back answer the oldest request
+  void complete(size_t bytes) {
+    const auto now = clock_type::now();
+    _partial += bytes;
+    while (_partial >= _message.size() && !_intended.empty()) {
+      _partial -= _message.size();
+      _res.latency.record((now - _intended.front()).count());
+      _res.service_time.record((now - _sent.front()).count());
+      _res.completed++;
+      _intended.pop_front();
+      _sent.pop_front();
+    }
+  }
+
+  void on_error() {
+    std::fprintf(stderr, "connection %d closed by the server\n", _fd);
+    std::exit(1);
+  }
+
+  hula::loop<>& _loop;
+  int _fd;
+  std::string _message;
+  results& _res;
+  hula::closer _closer;
+
+  std::deque<clock_type::time_point> _intended;
+  std::deque<clock_type::time_point> _sent;
+  std::vector<char> _out;
+  size_t _offset = 0;
+  size_t _partial = 0;
+  bool _want_write = false;
+};
+
+double us(int64_t ns) { return ns / 1000.0; }
+
+void print_histogram(const char* name, const hula::histogram& h) {
+  std::printf(
+      "%-14s p50=%.1fus p99=%.1fus p99.9=%.1fus max=%.1fus mean=%.1fus\n",
+      name, us(h.percentile(0.5)), us(h.percentile(0.99)),
+      us(h.percentile(0.999)), us(h.max()), h.mean() / 1000.0);
+}
+
+}  // namespace
+
+// open loop load generator for echo_server. requests of a fixed size are
+// sent at a constant rate, round robin over the connections, regardless of
+// how fast responses come back. latency is measured from each request's
+// intended send time, so stalls of the server or of the generator's own loop
+// show up in the tail instead of silently lowering the request rate. the
+// poll interval is the loop's default unless given, 0 busy polls.
+// usage: hula_loadgen [tcp|unix] [port|path] [connections] [requests/s]
+//                     [seconds] [message bytes] [poll interval us]
+int main(int argc, char** argv) {
+  const std::string transport = argc > 1 ? argv[1] : "tcp";
+  const std::string where = argc > 2 ? argv[2] : "9000";
+  const int connections = argc > 3 ? std::atoi(argv[3]) : 16;
+  const double rate = argc > 4 ? std::atof(argv[4]) : 10000;
+  const double seconds = argc > 5 ? std::atof(argv[5]) : 5;
+  const size_t message_size = argc > 6 ? std::atoi(argv[6]) : 64;
+  std::optional<std::chrono::microseconds> poll_interval;
+  if (argc > 7) poll_interval = std::chrono::microseconds(std::atoi(argv[7]));
+  if (connections <= 0 || rate <= 0 || message_size == 0) {
+    std::fprintf(stderr, "connections, rate and message size must be > 0\n");
+    return 1;
+  }
+
+  hula::loop loop;
+  if (poll_interval) {
+    loop.set_poll_interval(*poll_interval);
+    if (poll_interval->count() == 0 &&
+        std::thread::hardware_concurrency() < 2) {
+      std::fprintf(stderr,
+                   "warning: busy polling on fewer than 2 cores, the load "
+                   "generator and the server will compete for the cpu\n");
+    }
+  }
+
+  results res;
+  std::vector<std::unique_ptr<client>> clients;
+  for (int i = 0; i < connections; ++i) {
+    clients.push_back(std::make_unique<client>(
+        loop, connect_to(transport, where), message_size, res));
+  }
+
+  const auto interval = std::chrono::duration_cast<clock_type::duration>(
+      std::chrono::duration<double>(1.0 / rate));
+  const auto start = clock_type::now();
+  const auto end = start + std::chrono::duration_cast<clock_type::duration>(
+                               std::chrono::duration<double>(seconds));
+  // outstanding responses get this long after the last request
+  const auto drain_deadline = end + 1s;
+
+  auto next = start;
+  size_t next_client = 0;
+  hula::closer tick;
+  std::function<void()> send_due = [&] {
+    const auto now = clock_type::now();
+    // catch up on every request which is due, however late
+    while (next <= now && next < end) {
+      clients[next_client]->send(next, now);
+      next_client = (next_client + 1) % clients.size();
+      next += interval;
+    }
+    if (next < end) {
+      tick = loop.schedule(next - now, send_due);
+      return;
+    }
+
+    size_t in_flight = 0;
+    for (auto& c : clients) in_flight += c->in_flight();
+    if (in_flight == 0 || now >= drain_deadline) {
+      loop.stop();
+      return;
+    }
+    tick = loop.schedule(1ms, send_due);
+  };
+  tick = loop.schedule(send_due);
+  loop.run();
+
+  const double elapsed =
+      std::chrono::duration<double>(clock_type::now() - start).count();
+  const std::string poll =
+      poll_interval ? std::to_string(poll_interval->count()) + "us"
+                    : std::string("default");
+  std::printf(
+      "transport=%s connections=%d rate=%.0f/s duration=%.1fs size=%zu "
+      "poll_interval=%s\n",
+      transport.c_str(), connections, rate, seconds, message_size,
+      poll.c_str());
+  std::printf("sent=%lu completed=%lu incomplete=%lu throughput=%.0f/s\n",
+              static_cast<unsigned long>(res.sent),
+              static_cast<unsigned long>(res.completed),
+              static_cast<unsigned long>(res.sent - res.completed),
+              res.completed / elapsed);
+  print_histogram("latency", res.latency);
+  print_histogram("service time", res.service_time);
+  return res.completed == res.sent ? 0 : 2;
+}
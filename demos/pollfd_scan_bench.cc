@@ -0,0 +1,79 @@
+#include <hulaloop/pollfd_scan.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <numeric>
+#include <random>
+#include <vector>
+
+namespace {
+
+double ns_per_scan(hula::detail::next_ready_fn next_ready,
+                   const std::vector<struct pollfd>& fds, int ready,
+                   int rounds) {
+  const size_t n = fds.size();
+  size_t sink = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; ++r) {
+    int remaining = ready;
+    for (size_t i = next_ready(fds.data(), n, 0); i < n && remaining > 0;
+         i = next_ready(fds.data(), n, i + 1)) {
+      remaining--;
+      sink += i;
+    }
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  if (sink == 1) std::puts("");  // keep the scan alive
+  return static_cast<double>(
+             std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+                 .count()) /
+         rounds;
+}
+
+}  // namespace
+
+// cost of finding the ready entries of a pollfd array after poll, for
+// several ready/total ratios and each available scan.
+// usage: pollfd_scan_bench [total fds] [rounds]
+int main(int argc, char** argv) {
+  const size_t total = argc > 1 ? std::atoi(argv[1]) : 20000;
+  const int rounds = argc > 2 ? std::atoi(argv[2]) : 2000;
+
+  struct impl {
+    const char* name;
+    hula::detail::next_ready_fn fn;
+  };
+  std::vector<impl> impls{{"scalar", hula::detail::next_ready_scalar}};
+#if defined(_HULA_X86_SIMD)
+  impls.push_back({"sse2", hula::detail::next_ready_sse2});
+  if (__builtin_cpu_supports("avx2")) {
+    impls.push_back({"avx2", hula::detail::next_ready_avx2});
+  }
+#endif
+
+  std::printf("%zu fds, selected scan: %s\n", total,
+              hula::detail::pollfd_scan.name);
+  std::printf("%8s", "ready");
+  for (const auto& i : impls) std::printf(" %12s", i.name);
+  std::printf("\n");
+
+  std::mt19937 rng(1);
+  for (size_t ready : {size_t{1}, size_t{3}, total / 1000, total / 100,
+                       total / 10, total}) {
+    if (ready == 0) continue;
+    std::vector<struct pollfd> fds(total);
+    std::vector<size_t> idx(total);
+    std::iota(idx.begin(), idx.end(), 0);
+    std::shuffle(idx.begin(), idx.end(), rng);
+    for (size_t i = 0; i < ready; ++i) fds[idx[i]].revents = POLLIN;
+
+    std::printf("%8zu", ready);
+    for (const auto& i : impls) {
+      std::printf(" %9.0f ns",
+                  ns_per_scan(i.fn, fds, static_cast<int>(ready), rounds));
+    }
+    std::printf("\n");
+  }
+}
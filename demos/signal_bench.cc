@@ -0,0 +1,143 @@
+#include <hulaloop/signal.h>
+#include <hulaloop/static_signal.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <span>
+#include <vector>
+
+namespace {
+
+// a market data sized payload
+struct book_update {
+  static inline uint64_t copies = 0;
+
+  std::array<double, 64> bids{};
+  std::array<double, 64> asks{};
+
+  book_update() = default;
+  book_update(const book_update& o) : bids(o.bids), asks(o.asks) { copies++; }
+  book_update(book_update&&) = default;
+};
+
+template <class Signal>
+void run(const char* name, int slots, int fires) {
+  Signal s;
+  double sink = 0;
+  std::vector<hula::closer> closers;
+  for (int i = 0; i < slots; ++i) {
+    closers.push_back(
+        s.connect([&](const book_update& u) { sink += u.bids[0]; }));
+  }
+
+  book_update update;
+  book_update::copies = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < fires; ++i) {
+    update.bids[0] = i;
+    s(update);
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed);
+  std::printf("%-10s %8.1f ns/fire %8.2f copies/fire (sink %.0f)\n", name,
+              static_cast<double>(ns.count()) / fires,
+              static_cast<double>(book_update::copies) / fires, sink);
+}
+
+// delivering a batch of decoded messages one fire at a time, with fire_batch
+// to item slots and with fire_batch to batch slots
+void run_batches(int slots, int fires) {
+  constexpr size_t k_batch = 500;
+  std::vector<int> items(k_batch, 1);
+  const int rounds = std::max<int>(fires / k_batch, 1);
+
+  auto time = [&](const char* name, auto&& connect, auto&& fire) {
+    hula::signal<int> s;
+    int64_t sink = 0;
+    std::vector<hula::closer> closers;
+    for (int i = 0; i < slots; ++i) closers.push_back(connect(s, sink));
+
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r) fire(s);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed);
+    std::printf("%-10s %8.1f ns/item (sink %ld)\n", name,
+                static_cast<double>(ns.count()) / (rounds * k_batch),
+                static_cast<long>(sink));
+  };
+
+  auto item_slot = [](hula::signal<int>& s, int64_t& sink) {
+    return s.connect([&sink](int v) { sink += v; });
+  };
+  auto batch_slot = [](hula::signal<int>& s, int64_t& sink) {
+    return s.connect_batch([&sink](std::span<const int> vs) {
+      for (int v : vs) sink += v;
+    });
+  };
+  auto fire_each = [&](hula::signal<int>& s) {
+    for (int v : items) s(v);
+  };
+  auto fire_batch = [&](hula::signal<int>& s) { s.fire_batch(items); };
+
+  std::printf("batches of %zu\n", k_batch);
+  time("each", item_slot, fire_each);
+  time("batch", item_slot, fire_batch);
+  time("batch slot", batch_slot, fire_batch);
+}
+
+// a fixed set of three subscribers through a dynamic signal and a
+// static_signal
+void run_static(int fires) {
+  struct order {
+    int64_t qty = 0;
+    int64_t price = 0;
+  };
+
+  int64_t exposure = 0, logged = 0, published = 0;
+  auto risk = [&](const order& o) { exposure += o.qty * o.price; };
+  auto log = [&](const order& o) { logged += o.qty; };
+  auto publish = [&](const order& o) { published += o.price; };
+
+  auto time = [&](const char* name, auto& s) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < fires; ++i) s(order{.qty = i, .price = 2});
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed);
+    std::printf("%-10s %8.1f ns/fire (sink %ld)\n", name,
+                static_cast<double>(ns.count()) / fires,
+                static_cast<long>(exposure + logged + published));
+  };
+
+  std::printf("3 fixed slots\n");
+  hula::signal<order> dynamic;
+  auto c1 = dynamic.connect(risk);
+  auto c2 = dynamic.connect(log);
+  auto c3 = dynamic.connect(publish);
+  time("signal", dynamic);
+
+  auto fixed = hula::make_static_signal<order>(risk, log, publish);
+  time("static", fixed);
+}
+
+}  // namespace
+
+// cost of firing a 1KiB payload to many slots, by const reference (the
+// default) versus by value, of firing batches of small messages, and of
+// dynamic versus static dispatch.
+// usage: signal_bench [slots] [fires]
+int main(int argc, char** argv) {
+  const int slots = argc > 1 ? std::atoi(argv[1]) : 32;
+  const int fires = argc > 2 ? std::atoi(argv[2]) : 200000;
+
+  std::printf("%d slots, %d fires\n", slots, fires);
+  run<hula::signal<book_update>>("const&", slots, fires);
+  run<hula::signal<hula::by_value<book_update>>>("by_value", slots, fires);
+  run_batches(slots, fires);
+  run_static(fires * 10);
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include "loop.h"
+#include "net.h"
+#include "signal.h"
+#include "sys.h"
+
+#if !defined(_HULA_LINUX)
+#error "hula::acceptor requires linux (accept4)"
+#endif
+
+#include <cerrno>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace hula {
+
+// a connection accepted by an acceptor. the receiver owns the fd, which is
+// already non-blocking and close-on-exec.
+struct accepted_connection {
+  int fd = -1;
+  sockaddr_storage peer{};
+  socklen_t peer_len = 0;
+};
+
+// listens on a tcp socket registered with the loop and drains the accept
+// backlog in batches each time it becomes readable.
+template <class Clock = std::chrono::steady_clock>
+class acceptor {
+ public:
+  using clock = Clock;
+  using batch_slot =
+      slot<std::span<const accepted_connection>, struct acceptor_slot_tag>;
+
+  struct options {
+    int backlog = SOMAXCONN;
+    // accepts performed per readable callback, the rest wait for the next
+    // cycle so other fds are not starved during a connection storm
+    size_t max_accepts_per_cycle = 64;
+    // allow several acceptors (e.g. one per loop/thread) to bind the same
+    // port, with the kernel load balancing connections between them
+    bool reuse_port = false;
+  };
+
+  explicit acceptor(loop<clock>& l, batch_slot slot)
+      : acceptor(l, slot, options{}) {}
+
+  explicit acceptor(loop<clock>& l, batch_slot slot, options opts)
+      : _loop(l), _slot(slot), _options(opts) {
+    _batch.reserve(_options.max_accepts_per_cycle);
+  }
+
+  ~acceptor() { close(); }
+
+  acceptor(const acceptor&) = delete;
+  acceptor& operator=(const acceptor&) = delete;
+
+  // bind to the given ipv4 or ipv6 address and start accepting.
+  // a port of 0 binds an ephemeral port, see port().
+  void listen(const std::string& address, uint16_t port) {
+    auto addr = net::address::parse(address, port);
+    listen(addr.get(), addr.len);
+  }
+
+  void listen(const sockaddr* addr, socklen_t len) {
+    close();
+
+    int fd = ::socket(addr->sa_family,
+                      SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) fail("socket");
+    _fd = fd;
+
+    int one = 1;
+    if (::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0) {
+      fail("setsockopt(SO_REUSEADDR)");
+    }
+    if (_options.reuse_port &&
+        ::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) != 0) {
+      fail("setsockopt(SO_REUSEPORT)");
+    }
+    if (::bind(fd, addr, len) != 0) fail("bind");
+    if (::listen(fd, _options.backlog) != 0) fail("listen");
+
+    _closer = _loop.add_fd(
+        fd, fd_slots{.readable = [this](int) { drain(); }}, fd_events::read);
+  }
+
+  // stop accepting and close the listening socket
+  void close() {
+    _closer.close();
+    if (_fd >= 0) ::close(_fd);
+    _fd = -1;
+  }
+
+  int fd() const { return _fd; }
+
+  // the bound port, useful after binding port 0
+  uint16_t port() const {
+    return _fd < 0 ? 0 : net::address::local(_fd).port();
+  }
+
+  // total connections handed to the slot
+  uint64_t accepted() const { return _accepted; }
+
+  // accept failures other than an empty backlog, e.g. EMFILE
+  uint64_t errors() const { return _errors; }
+
+ private:
+  void drain() {
+    while (_batch.size() < _options.max_accepts_per_cycle) {
+      accepted_connection c;
+      c.peer_len = sizeof(c.peer);
+      c.fd = ::accept4(_fd, reinterpret_cast<sockaddr*>(&c.peer), &c.peer_len,
+                       SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (c.fd >= 0) {
+        _batch.push_back(c);
+        continue;
+      }
+
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK) _errors++;
+      break;
+    }
+
+    if (_batch.empty()) return;
+
+    _accepted += _batch.size();
+    _slot(_batch);
+    _batch.clear();
+  }
+
+  [[noreturn]] void fail(const char* what) {
+    std::string msg = std::string("hula::acceptor => ") + what +
+                      " failed: " + std::strerror(errno);
+    close();
+    throw std::runtime_error(msg);
+  }
+
+  loop<clock>& _loop;
+  batch_slot _slot;
+  options _options;
+  int _fd = -1;
+  closer _closer;
+  std::vector<accepted_connection> _batch;
+  uint64_t _accepted = 0;
+  uint64_t _errors = 0;
+};
+
+}  // namespace hula
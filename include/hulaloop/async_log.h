@@ -0,0 +1,405 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace hula {
+
+// what logging does when the calling thread's ring is full
+enum class log_overflow {
+  drop,   // discard the line and count it
+  block,  // wait for the writer to make room
+};
+
+// log sink which keeps disk and pipe stalls off the calling threads. each
+// thread appends lines to its own preallocated ring, formatting straight into
+// it where possible, so logging costs the formatting plus at most a memcpy
+// and never a syscall. a writer thread wakes every flush_interval and writes
+// whatever all rings hold with a few large writev calls. the ring of a thread
+// which exited is handed to the next new thread once it has been written.
+class async_log {
+ public:
+  struct options {
+    // bytes per thread ring, rounded up to a power of two
+    size_t ring_size = 1 << 20;
+    log_overflow overflow = log_overflow::drop;
+    // longer formatted lines are truncated
+    size_t max_line = 1024;
+    std::chrono::microseconds flush_interval = std::chrono::milliseconds(1);
+  };
+
+  // fd stays owned by the caller and must outlive the log
+  explicit async_log(int fd) : async_log(fd, options{}) {}
+
+  explicit async_log(int fd, options opts)
+      : _fd(fd), _options(opts), _id(s_next_id++) {
+    if (_options.max_line == 0) {
+      throw std::invalid_argument("hula::async_log => max_line must be > 0");
+    }
+    _options.ring_size = std::bit_ceil(
+        std::max(_options.ring_size, 2 * _options.max_line + 2));
+    _writer = std::thread([this] { run(); });
+  }
+
+  // writes everything logged so far before returning
+  ~async_log() {
+    {
+      std::lock_guard lock(_wake_mutex);
+      _stopping = true;
+    }
+    _wake.notify_one();
+    _writer.join();
+  }
+
+  async_log(const async_log&) = delete;
+  async_log& operator=(const async_log&) = delete;
+
+  // append bytes as they are, e.g. a line with its newline
+  bool write(std::string_view s) { return push(local_ring(), s); }
+
+  // printf style, a newline is appended
+  __attribute__((format(printf, 2, 3))) bool logf(const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    bool res = vlog(nullptr, fmt, ap);
+    va_end(ap);
+    return res;
+  }
+
+  // prefixed with the time as seconds.microseconds, e.g. from
+  // loop.cached_wall_time() so logging doesn't read the clock
+  __attribute__((format(printf, 3, 4))) bool logf_at(
+      std::chrono::system_clock::time_point t, const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    bool res = vlog(&t, fmt, ap);
+    va_end(ap);
+    return res;
+  }
+
+  // block until everything logged so far has been written
+  void flush() {
+    std::vector<std::pair<ring*, uint64_t>> targets;
+    {
+      std::lock_guard lock(_rings_mutex);
+      for (auto& r : _rings) {
+        auto head = r->_head.load(std::memory_order_acquire);
+        targets.emplace_back(r.get(), head);
+      }
+    }
+    wake();
+    for (auto& [r, head] : targets) {
+      while (r->_tail.load(std::memory_order_acquire) < head) {
+        std::this_thread::sleep_for(std::chrono::microseconds(20));
+      }
+    }
+  }
+
+  // lines discarded because a ring was full
+  uint64_t dropped() const {
+    std::lock_guard lock(_rings_mutex);
+    uint64_t total = 0;
+    for (auto& r : _rings) {
+      total += r->_dropped.load(std::memory_order_relaxed);
+    }
+    return total;
+  }
+
+  uint64_t bytes_written() const {
+    return _bytes_written.load(std::memory_order_relaxed);
+  }
+
+  uint64_t writev_calls() const {
+    return _writev_calls.load(std::memory_order_relaxed);
+  }
+
+  // thread rings allocated so far
+  size_t rings() const {
+    std::lock_guard lock(_rings_mutex);
+    return _rings.size();
+  }
+
+ private:
+  // single producer (the owning thread), single consumer (the writer)
+  struct ring {
+    explicit ring(size_t size, size_t max_line)
+        : _data(new char[size]), _mask(size - 1), _scratch(max_line + 1) {}
+
+    size_t capacity() const { return _mask + 1; }
+
+    std::unique_ptr<char[]> _data;
+    size_t _mask;
+    // for lines which don't fit before the end of the ring
+    std::vector<char> _scratch;
+    std::atomic<uint64_t> _dropped{0};
+    // set when the owning thread exits
+    std::atomic<bool> _orphaned{false};
+    alignas(64) std::atomic<uint64_t> _head{0};
+    alignas(64) std::atomic<uint64_t> _tail{0};
+  };
+
+  // zero initialized, like any thread_local
+  struct thread_cache {
+    uint64_t _log_id;
+    ring* _ring;
+  };
+
+  // the rings a thread owns, by log id, orphaned when it exits. weak so a
+  // log destroyed before the thread exits isn't touched.
+  struct thread_rings {
+    std::vector<std::pair<uint64_t, std::weak_ptr<ring>>> _owned;
+
+    ~thread_rings() {
+      for (auto& [id, weak] : _owned) {
+        if (auto r = weak.lock()) {
+          r->_orphaned.store(true, std::memory_order_release);
+        }
+      }
+    }
+  };
+
+  static inline std::atomic<uint64_t> s_next_id{1};
+  static inline thread_local thread_cache t_cache;
+  static inline thread_local thread_rings t_rings;
+
+  ring& local_ring() {
+    if (t_cache._log_id == _id) [[likely]]
+      return *t_cache._ring;
+
+    auto& owned = t_rings._owned;
+    auto it = std::find_if(owned.begin(), owned.end(),
+                           [&](const auto& o) { return o.first == _id; });
+    ring* r = nullptr;
+    if (it != owned.end()) {
+      r = it->second.lock().get();
+    } else {
+      std::shared_ptr<ring> taken = take_ring();
+      r = taken.get();
+      std::erase_if(owned, [](const auto& o) { return o.second.expired(); });
+      owned.emplace_back(_id, std::move(taken));
+    }
+    t_cache = thread_cache{._log_id = _id, ._ring = r};
+    return *r;
+  }
+
+  // an orphaned ring which has been written out, or a new one
+  std::shared_ptr<ring> take_ring() {
+    std::lock_guard lock(_rings_mutex);
+    for (auto& r : _rings) {
+      if (r->_orphaned.load(std::memory_order_acquire) &&
+          r->_tail.load(std::memory_order_acquire) ==
+              r->_head.load(std::memory_order_relaxed)) {
+        r->_orphaned.store(false, std::memory_order_relaxed);
+        return r;
+      }
+    }
+    _rings.push_back(
+        std::make_shared<ring>(_options.ring_size, _options.max_line));
+    return _rings.back();
+  }
+
+  bool vlog(const std::chrono::system_clock::time_point* t, const char* fmt,
+            va_list ap) {
+    ring& r = local_ring();
+    const uint64_t head = r._head.load(std::memory_order_relaxed);
+    const uint64_t used = head - r._tail.load(std::memory_order_acquire);
+    const size_t pos = head & r._mask;
+    const size_t contiguous =
+        std::min<size_t>(r.capacity() - used, r.capacity() - pos);
+
+    // format in place when the whole line fits before the end of the ring,
+    // otherwise in the scratch buffer, copied in two pieces
+    va_list retry;
+    va_copy(retry, ap);
+    size_t len = format(r._data.get() + pos,
+                        std::min(contiguous, _options.max_line + 1), t, fmt,
+                        ap);
+    if (len + 1 <= contiguous && len < _options.max_line) {
+      va_end(retry);
+      r._data[pos + len] = '\n';
+      r._head.store(head + len + 1, std::memory_order_release);
+      return true;
+    }
+    len = format(r._scratch.data(), r._scratch.size(), t, fmt, retry);
+    va_end(retry);
+    len = std::min(len, _options.max_line - 1);
+    r._scratch[len] = '\n';
+    return push(r, std::string_view(r._scratch.data(), len + 1));
+  }
+
+  // formats into buf, returning the length written without the terminator
+  static size_t format(char* buf, size_t cap,
+                       const std::chrono::system_clock::time_point* t,
+                       const char* fmt, va_list ap) {
+    if (cap == 0) return 0;
+    size_t len = 0;
+    if (t) {
+      auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                    t->time_since_epoch())
+                    .count();
+      int n = std::snprintf(buf, cap, "%lld.%06lld ",
+                            static_cast<long long>(us / 1000000),
+                            static_cast<long long>(us % 1000000));
+      // reporting a truncated line sends the caller to the scratch buffer
+      if (n < 0 || static_cast<size_t>(n) >= cap) return cap;
+      len = n;
+    }
+    int n = std::vsnprintf(buf + len, cap - len, fmt, ap);
+    return len + std::max(n, 0);
+  }
+
+  bool push(ring& r, std::string_view s) {
+    if (s.size() > r.capacity()) {
+      r._dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    const uint64_t head = r._head.load(std::memory_order_relaxed);
+    while (head + s.size() - r._tail.load(std::memory_order_acquire) >
+           r.capacity()) {
+      if (_options.overflow == log_overflow::drop) {
+        r._dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      wake();
+      std::this_thread::sleep_for(std::chrono::microseconds(10));
+    }
+
+    const size_t pos = head & r._mask;
+    const size_t first = std::min(s.size(), r.capacity() - pos);
+    std::memcpy(r._data.get() + pos, s.data(), first);
+    std::memcpy(r._data.get(), s.data() + first, s.size() - first);
+    r._head.store(head + s.size(), std::memory_order_release);
+    return true;
+  }
+
+  void wake() {
+    {
+      std::lock_guard lock(_wake_mutex);
+      _wake_requested = true;
+    }
+    _wake.notify_one();
+  }
+
+  void run() {
+    for (;;) {
+      bool stopping;
+      {
+        std::unique_lock lock(_wake_mutex);
+        _wake.wait_for(lock, _options.flush_interval,
+                       [this] { return _wake_requested || _stopping; });
+        _wake_requested = false;
+        stopping = _stopping;
+      }
+      while (drain() > 0) {
+      }
+      if (stopping) return;
+    }
+  }
+
+  // writes what the rings hold, returning the bytes taken from them
+  size_t drain() {
+    {
+      std::lock_guard lock(_rings_mutex);
+      _snapshot.clear();
+      for (auto& r : _rings) _snapshot.push_back(r.get());
+    }
+
+    _iov.clear();
+    _taken.clear();
+    size_t total = 0;
+    for (ring* r : _snapshot) {
+      if (_iov.size() + 2 > k_max_iov) break;
+      const uint64_t tail = r->_tail.load(std::memory_order_relaxed);
+      const uint64_t len = r->_head.load(std::memory_order_acquire) - tail;
+      if (len == 0) continue;
+      const size_t pos = tail & r->_mask;
+      const size_t first = std::min<size_t>(len, r->capacity() - pos);
+      _iov.push_back(iovec{r->_data.get() + pos, first});
+      if (len > first) _iov.push_back(iovec{r->_data.get(), len - first});
+      _taken.emplace_back(r, tail + len);
+      total += len;
+    }
+    if (total == 0) return 0;
+
+    write_all();
+    _bytes_written.fetch_add(total, std::memory_order_relaxed);
+    for (auto& [r, tail] : _taken) {
+      r->_tail.store(tail, std::memory_order_release);
+    }
+    return total;
+  }
+
+  // writes the gathered iovecs, resuming after partial writes. on errors
+  // other than a full non-blocking fd the rest is discarded so loggers
+  // can't block forever.
+  void write_all() {
+    iovec* iov = _iov.data();
+    size_t n = _iov.size();
+    while (n > 0) {
+      auto res = ::writev(_fd, iov, static_cast<int>(n));
+      _writev_calls.fetch_add(1, std::memory_order_relaxed);
+      if (res < 0) {
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          std::this_thread::sleep_for(_options.flush_interval);
+          continue;
+        }
+        return;
+      }
+      auto written = static_cast<size_t>(res);
+      while (n > 0 && written >= iov->iov_len) {
+        written -= iov->iov_len;
+        ++iov;
+        --n;
+      }
+      if (n > 0) {
+        iov->iov_base = static_cast<char*>(iov->iov_base) + written;
+        iov->iov_len -= written;
+      }
+    }
+  }
+
+  // the kernel's limit on iovecs per writev (IOV_MAX)
+  static constexpr size_t k_max_iov = 1024;
+
+  int _fd;
+  options _options;
+  const uint64_t _id;
+
+  mutable std::mutex _rings_mutex;
+  std::vector<std::shared_ptr<ring>> _rings;
+
+  std::mutex _wake_mutex;
+  std::condition_variable _wake;
+  bool _wake_requested = false;
+  bool _stopping = false;
+
+  std::atomic<uint64_t> _bytes_written{0};
+  std::atomic<uint64_t> _writev_calls{0};
+
+  // writer thread only
+  std::vector<ring*> _snapshot;
+  std::vector<iovec> _iov;
+  std::vector<std::pair<ring*, uint64_t>> _taken;
+
+  std::thread _writer;
+};
+
+}  // namespace hula
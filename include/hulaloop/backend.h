@@ -0,0 +1,39 @@
+#pragma once
+
+#include "unix_sig.h"
+
+#include <chrono>
+#include <cstdint>
+#include <span>
+#include <thread>
+
+#include <sys/poll.h>
+
+namespace hula {
+
+// stands between a loop and the kernel. attached at runtime with
+// loop::set_backend, like a heartbeat, so any loop<Clock> and every helper
+// taking one can be recorded or replayed. without a backend the loop polls
+// and sleeps by itself.
+//
+// times are nanoseconds since the epoch of the loop's clock.
+class backend {
+ public:
+  virtual ~backend() = default;
+
+  // same semantics as ::poll with a zero timeout
+  virtual int poll(std::span<struct pollfd> fds, int64_t /*now_ns*/) {
+    return ::poll(fds.data(), fds.size(), 0);
+  }
+
+  // the loop has nothing to do for d
+  virtual void sleep(std::chrono::nanoseconds d) {
+    std::this_thread::sleep_for(d);
+  }
+
+  // called before a timer callback or unix signal slot runs
+  virtual void on_timer(uint64_t /*id*/, int64_t /*now_ns*/) {}
+  virtual void on_unix_signal(unix::sig /*s*/, int64_t /*now_ns*/) {}
+};
+
+}  // namespace hula
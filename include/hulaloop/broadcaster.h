@@ -0,0 +1,295 @@
+#pragma once
+
+#include "loop.h"
+#include "signal.h"
+#include "sys.h"
+
+#if !defined(_HULA_LINUX)
+#error "hula::broadcaster requires linux (MSG_NOSIGNAL)"
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+namespace hula {
+
+// what a broadcaster does with a subscriber whose queue is full
+enum class slow_consumer_policy {
+  drop,        // discard the new message for this subscriber
+  conflate,    // discard everything queued, keeping only the new message
+  disconnect,  // remove the subscriber
+};
+
+// a subscriber removed by a broadcaster
+struct broadcast_disconnect {
+  uint64_t id = 0;
+  int fd = -1;
+  // errno of the failed write, 0 if removed by the slow consumer policy
+  int error = 0;
+};
+
+// publishes messages to many stream sockets. each message is copied once
+// into an immutable reference counted buffer, queued by reference for every
+// subscriber and written with a single gather write per subscriber, so
+// publishing costs one copy however many subscribers there are. a buffer is
+// freed once every subscriber wrote it. fds remain owned by the caller and
+// must not be registered with the loop elsewhere.
+template <class Clock = std::chrono::steady_clock>
+class broadcaster {
+ public:
+  using clock = Clock;
+  using buffer = std::shared_ptr<const std::vector<std::byte>>;
+  using disconnect_slot =
+      slot<const broadcast_disconnect&, struct broadcast_disconnect_slot_tag>;
+
+  struct options {
+    // messages queued per subscriber before the policy applies
+    size_t max_queued = 1024;
+    slow_consumer_policy policy = slow_consumer_policy::disconnect;
+  };
+
+  struct stats {
+    uint64_t published = 0;
+    uint64_t bytes_copied = 0;
+    uint64_t send_calls = 0;
+    uint64_t dropped = 0;
+    uint64_t conflated = 0;
+    uint64_t disconnected = 0;
+  };
+
+  explicit broadcaster(loop<clock>& l, disconnect_slot on_disconnect)
+      : broadcaster(l, on_disconnect, options{}) {}
+
+  explicit broadcaster(loop<clock>& l, disconnect_slot on_disconnect,
+                       options opts)
+      : _loop(l), _on_disconnect(on_disconnect), _options(opts) {}
+
+  broadcaster(const broadcaster&) = delete;
+  broadcaster& operator=(const broadcaster&) = delete;
+
+  // start sending published messages to the stream socket. returns the
+  // subscriber id.
+  uint64_t subscribe(int fd) {
+    auto id = _next_id++;
+    auto& sub = _subscribers[id];
+    sub._fd = fd;
+    sub._closer = _loop.add_fd(
+        fd,
+        fd_slots{
+            .writable = [this, id](int) { flush(id); },
+            .error = [this, id](int fd) { remove(id, socket_error(fd)); },
+        },
+        fd_events::none);
+    return id;
+  }
+
+  // stop sending to the subscriber, discarding anything queued
+  void unsubscribe(uint64_t id) { _subscribers.erase(id); }
+
+  // copy the message once and queue it for every subscriber. queues are
+  // flushed at the end of the cycle.
+  void publish(std::span<const std::byte> msg) {
+    publish(std::make_shared<const std::vector<std::byte>>(msg.begin(),
+                                                           msg.end()));
+    _stats.bytes_copied += msg.size();
+  }
+
+  // queue an existing buffer for every subscriber, without copying
+  void publish(buffer msg) {
+    _stats.published++;
+    for (auto& [id, sub] : _subscribers) {
+      if (sub._queue.size() >= _options.max_queued && !overflow(sub)) {
+        if (_options.policy == slow_consumer_policy::disconnect) {
+          _slow.push_back(id);
+        }
+        continue;
+      }
+      sub._queue.push_back(msg);
+      if (!sub._dirty) {
+        sub._dirty = true;
+        _dirty.push_back(id);
+      }
+    }
+    for (auto id : _slow) remove(id, 0);
+    _slow.clear();
+
+    if (!_dirty.empty() && !_flush_closer) {
+      _flush_closer = _loop.schedule([this] { flush_all(); });
+    }
+  }
+
+  // write everything queued now rather than at the end of the cycle
+  void flush() {
+    _flush_closer.close();
+    flush_all();
+  }
+
+  size_t subscribers() const { return _subscribers.size(); }
+
+  // messages queued for the subscriber, 0 if unknown
+  size_t queued(uint64_t id) const {
+    auto it = _subscribers.find(id);
+    return it == _subscribers.end() ? 0 : it->second._queue.size();
+  }
+
+  const stats& statistics() const { return _stats; }
+
+ private:
+  // the kernel's limit on iovecs per call (IOV_MAX)
+  static constexpr size_t k_max_iov = 1024;
+
+  struct subscriber {
+    int _fd = -1;
+    std::deque<buffer> _queue;
+    // bytes of the front message already written
+    size_t _offset = 0;
+    bool _want_write = false;
+    bool _dirty = false;
+    closer _closer;
+  };
+
+  // applies the slow consumer policy, returns whether to still queue
+  bool overflow(subscriber& sub) {
+    switch (_options.policy) {
+      case slow_consumer_policy::drop:
+        _stats.dropped++;
+        return false;
+      case slow_consumer_policy::conflate: {
+        // a partially written message must complete to keep the stream
+        // framed
+        size_t keep = sub._offset > 0 ? 1 : 0;
+        _stats.conflated += sub._queue.size() - keep;
+        sub._queue.erase(sub._queue.begin() + keep, sub._queue.end());
+        return true;
+      }
+      case slow_consumer_policy::disconnect:
+        return false;
+    }
+    return false;
+  }
+
+  void flush_all() {
+    _flush_closer = closer();
+    _flushing.swap(_dirty);
+    for (auto id : _flushing) {
+      auto it = _subscribers.find(id);
+      if (it == _subscribers.end()) continue;
+      it->second._dirty = false;
+      flush(id);
+    }
+    _flushing.clear();
+  }
+
+  void flush(uint64_t id) {
+    auto it = _subscribers.find(id);
+    if (it == _subscribers.end()) return;
+    auto& sub = it->second;
+
+    while (!sub._queue.empty()) {
+      const size_t n = std::min(sub._queue.size(), k_max_iov);
+      _iov.resize(n);
+      for (size_t i = 0; i < n; ++i) {
+        const auto& msg = *sub._queue[i];
+        size_t skip = i == 0 ? sub._offset : 0;
+        _iov[i] = iovec{const_cast<std::byte*>(msg.data()) + skip,
+                        msg.size() - skip};
+      }
+
+      // sendmsg is writev with flags, so a closed peer is an EPIPE error
+      // rather than a SIGPIPE
+      msghdr hdr{};
+      hdr.msg_iov = _iov.data();
+      hdr.msg_iovlen = n;
+      auto res = ::sendmsg(sub._fd, &hdr, MSG_NOSIGNAL | MSG_DONTWAIT);
+      _stats.send_calls++;
+      if (res < 0) {
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+        remove(id, errno);
+        return;
+      }
+      consume(sub, res);
+    }
+
+    bool want_write = !sub._queue.empty();
+    if (want_write != sub._want_write) {
+      sub._want_write = want_write;
+      _loop.update_fd(sub._fd, want_write ? fd_events::write : fd_events::none);
+    }
+  }
+
+  // drops fully written messages, releasing their references
+  static void consume(subscriber& sub, size_t written) {
+    while (written > 0 && !sub._queue.empty()) {
+      size_t left = sub._queue.front()->size() - sub._offset;
+      if (written < left) {
+        sub._offset += written;
+        return;
+      }
+      written -= left;
+      sub._offset = 0;
+      sub._queue.pop_front();
+    }
+    // empty messages are complete without writing anything
+    while (!sub._queue.empty() && sub._queue.front()->empty()) {
+      sub._queue.pop_front();
+    }
+  }
+
+  static int socket_error(int fd) {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    ::getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
+    // a hangup carries no socket error
+    return err ? err : EPIPE;
+  }
+
+  void remove(uint64_t id, int error) {
+    auto it = _subscribers.find(id);
+    if (it == _subscribers.end()) return;
+    _pending_disconnects.push_back(
+        broadcast_disconnect{.id = id, .fd = it->second._fd, .error = error});
+    _subscribers.erase(it);
+    _stats.disconnected++;
+
+    // deferred so the slot may safely destroy the broadcaster
+    if (!_notify_closer) {
+      _notify_closer = _loop.schedule([this] { notify_disconnects(); });
+    }
+  }
+
+  void notify_disconnects() {
+    _notify_closer = closer();
+    auto pending = std::move(_pending_disconnects);
+    _pending_disconnects.clear();
+    auto on_disconnect = _on_disconnect;
+    for (const auto& d : pending) on_disconnect(d);
+  }
+
+  loop<clock>& _loop;
+  disconnect_slot _on_disconnect;
+  options _options;
+  stats _stats;
+
+  uint64_t _next_id = 1;
+  std::unordered_map<uint64_t, subscriber> _subscribers;
+  std::vector<uint64_t> _dirty;
+  std::vector<uint64_t> _flushing;
+  std::vector<uint64_t> _slow;
+  std::vector<iovec> _iov;
+  closer _flush_closer;
+
+  std::vector<broadcast_disconnect> _pending_disconnects;
+  closer _notify_closer;
+};
+
+}  // namespace hula
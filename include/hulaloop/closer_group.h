@@ -0,0 +1,95 @@
+#pragma once
+
+#include "closer.h"
+#include "loop.h"
+#include "signal.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace hula {
+
+// owns the loop registrations of one entity, e.g. a connection, and tears
+// them all down at once. fds and callbacks are registered by value, without a
+// closer each. closing from inside a cycle only marks them removed, and the
+// loop sweeps its tables once at the end of the cycle, so many connections
+// dying together cost one pass in total rather than one per connection or
+// handle. other closers (e.g. signal connections) can be adopted and are
+// closed along with the rest.
+// closes on destruction.
+template <class Clock = std::chrono::steady_clock>
+class closer_group {
+ public:
+  using clock = Clock;
+
+  explicit closer_group(loop<clock>& l) : _loop(l) {}
+
+  ~closer_group() { close(); }
+
+  closer_group(const closer_group&) = delete;
+  closer_group& operator=(const closer_group&) = delete;
+
+  // see loop::add_fd
+  void add_fd(int fd, fd_slots slots, fd_events events) {
+    _loop.register_fd(typename loop<clock>::fd_handler{
+        ._fd = fd, ._slots = slots, ._events = events});
+    _fds.push_back(fd);
+  }
+
+  // see loop::add_fd_batched
+  void add_fd_batched(int fd, void* user_data, fd_events events) {
+    _loop.register_fd(typename loop<clock>::fd_handler{._fd = fd,
+                                                      ._events = events,
+                                                      ._user_data = user_data,
+                                                      ._batched = true});
+    _fds.push_back(fd);
+  }
+
+  // see loop::post. the id may also be cancelled with loop::cancel_callback.
+  uint64_t post(slot<> cb) { return post(0ns, cb); }
+
+  uint64_t post(clock::duration fire_in, slot<> cb) {
+    auto id = _loop.post(fire_in, std::move(cb));
+    _callbacks.push_back(id);
+    // forget fired ids now and then, so a long lived group that keeps
+    // posting doesn't grow
+    if (_callbacks.size() >= _prune_at) {
+      _loop.retain_pending(_callbacks);
+      _prune_at = std::max(k_min_prune, 2 * _callbacks.size());
+    }
+    return id;
+  }
+
+  // closed along with the group
+  void adopt(closer c) { _closers.push_back(std::move(c)); }
+
+  // fds and pending callbacks registered through the group
+  size_t fds() const { return _fds.size(); }
+  size_t callbacks() const {
+    _loop.retain_pending(_callbacks);
+    return _callbacks.size();
+  }
+
+  void close() {
+    _loop.remove_fds(_fds);
+    _fds.clear();
+    _loop.cancel_callbacks(_callbacks);
+    _callbacks.clear();
+
+    for (auto& c : _closers) c.close();
+    _closers.clear();
+  }
+
+ private:
+  static constexpr size_t k_min_prune = 64;
+
+  loop<clock>& _loop;
+  std::vector<int> _fds;
+  // ascending, may include callbacks which already fired
+  mutable std::vector<uint64_t> _callbacks;
+  size_t _prune_at = k_min_prune;
+  std::vector<closer> _closers;
+};
+
+}  // namespace hula
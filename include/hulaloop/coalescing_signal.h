@@ -0,0 +1,142 @@
+#pragma once
+
+#include "loop.h"
+#include "signal.h"
+
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace hula {
+
+// signal which only delivers the latest value. fires overwrite the pending
+// value, and a single post delivers it to the connected slots in the timers
+// phase of the loop cycle, so a burst of fires during fd dispatch results in
+// one slot call per cycle.
+template <class T, class Clock = std::chrono::steady_clock>
+class coalescing_signal {
+ public:
+  using clock = Clock;
+  using slot_type = typename signal<T>::slot_type;
+
+  explicit coalescing_signal(loop<clock>& l) : _loop(l) {}
+
+  coalescing_signal(const coalescing_signal&) = delete;
+  coalescing_signal& operator=(const coalescing_signal&) = delete;
+
+  template <class U>
+  void operator()(U&& value) {
+    _pending = std::forward<U>(value);
+    if (!_post_closer) {
+      _post_closer = _loop.schedule([this] { deliver(); });
+    }
+  }
+
+  closer connect(slot_type s) { return _signal.connect(s); }
+
+  bool dirty() const { return _pending.has_value(); }
+
+  // deliver the pending value now rather than later in the cycle. from
+  // inside a slot, it is delivered in the next cycle instead.
+  void flush() {
+    _post_closer.close();
+    deliver();
+  }
+
+ private:
+  void deliver() {
+    _post_closer = closer();
+    if (_in_delivery) {
+      // a slot flushed while _signal is firing
+      if (_pending) _post_closer = _loop.schedule([this] { deliver(); });
+      return;
+    }
+    if (!_pending) return;
+
+    _in_delivery = true;
+    // slots may fire again, which schedules the next delivery
+    auto value = std::move(*_pending);
+    _pending.reset();
+    _signal(value);
+    _in_delivery = false;
+  }
+
+  loop<clock>& _loop;
+  signal<T> _signal;
+  std::optional<T> _pending;
+  bool _in_delivery = false;
+  closer _post_closer;
+};
+
+// coalescing_signal keeping the latest value per key, e.g. per instrument.
+// dirty keys are delivered in the order they were first fired since the
+// last delivery, each once.
+template <class K, class T, class Clock = std::chrono::steady_clock>
+class keyed_coalescing_signal {
+ public:
+  using clock = Clock;
+  using slot_type = typename signal<K, T>::slot_type;
+
+  explicit keyed_coalescing_signal(loop<clock>& l) : _loop(l) {}
+
+  keyed_coalescing_signal(const keyed_coalescing_signal&) = delete;
+  keyed_coalescing_signal& operator=(const keyed_coalescing_signal&) = delete;
+
+  template <class U>
+  void operator()(const K& key, U&& value) {
+    auto [it, inserted] = _index.try_emplace(key, _pending.size());
+    if (inserted) {
+      _pending.emplace_back(key, std::forward<U>(value));
+    } else {
+      _pending[it->second].second = std::forward<U>(value);
+    }
+
+    if (!_post_closer) {
+      _post_closer = _loop.schedule([this] { deliver(); });
+    }
+  }
+
+  closer connect(slot_type s) { return _signal.connect(s); }
+
+  // number of keys waiting to be delivered
+  size_t dirty() const { return _pending.size(); }
+
+  // deliver the pending keys now. from inside a slot, they are delivered
+  // in the next cycle instead.
+  void flush() {
+    _post_closer.close();
+    deliver();
+  }
+
+ private:
+  void deliver() {
+    _post_closer = closer();
+    if (_in_delivery) {
+      // a slot flushed while _delivering is being iterated
+      if (!_pending.empty()) {
+        _post_closer = _loop.schedule([this] { deliver(); });
+      }
+      return;
+    }
+
+    _in_delivery = true;
+    _delivering.swap(_pending);
+    _index.clear();
+    // slots may fire again, filling _pending for the next delivery
+    for (const auto& [key, value] : _delivering) _signal(key, value);
+    _delivering.clear();
+    _in_delivery = false;
+  }
+
+  loop<clock>& _loop;
+  signal<K, T> _signal;
+  std::unordered_map<K, size_t> _index;
+  std::vector<std::pair<K, T>> _pending;
+  // kept to reuse its capacity
+  std::vector<std::pair<K, T>> _delivering;
+  bool _in_delivery = false;
+  closer _post_closer;
+};
+
+}  // namespace hula
@@ -0,0 +1,349 @@
+#pragma once
+
+#include "loop.h"
+#include "signal.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace hula {
+
+// outcome of an asynchronous file operation
+struct file_result {
+  // bytes transferred, 0 at end of file
+  size_t bytes = 0;
+  // errno of the failed operation, 0 on success
+  int error = 0;
+};
+
+// performs blocking regular file io on a small pool of worker threads,
+// delivering completions back on the loop thread. regular files are always
+// reported ready by poll, so reading them on the loop would stall it on every
+// page cache miss.
+template <class Clock = std::chrono::steady_clock>
+class file_io {
+ public:
+  using clock = Clock;
+  using completion_slot = slot<file_result, struct file_completion_slot_tag>;
+  using chunk_slot =
+      slot<std::span<const std::byte>, struct file_chunk_slot_tag>;
+  using stream_done_slot = slot<int, struct file_stream_done_slot_tag>;
+
+  struct options {
+    size_t threads = 2;
+  };
+
+  explicit file_io(loop<clock>& l) : file_io(l, options{}) {}
+
+  explicit file_io(loop<clock>& l, options opts) : _loop(l) {
+    int fds[2];
+    if (::pipe(fds) != 0) {
+      throw std::runtime_error("hula::file_io => pipe failed");
+    }
+    _wake_read = fds[0];
+    _wake_write = fds[1];
+    for (int fd : fds) {
+      ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+      ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+
+    _wake_closer = _loop.add_fd(
+        _wake_read, fd_slots{.readable = [this](int) { dispatch(); }},
+        fd_events::read);
+
+    for (size_t i = 0; i < std::max<size_t>(opts.threads, 1); ++i) {
+      _workers.emplace_back([this] { work(); });
+    }
+  }
+
+  // queued operations are discarded, running ones are waited for
+  ~file_io() {
+    {
+      std::lock_guard lock(_mutex);
+      _stopping = true;
+      _jobs.clear();
+    }
+    _cv.notify_all();
+    for (auto& w : _workers) w.join();
+
+    _wake_closer.close();
+    ::close(_wake_read);
+    ::close(_wake_write);
+  }
+
+  file_io(const file_io&) = delete;
+  file_io& operator=(const file_io&) = delete;
+
+  // read up to buf.size() bytes at offset. buf must remain valid until the
+  // slot is called, or until this object is destroyed if the handle is
+  // closed first.
+  closer read(int fd, off_t offset, std::span<std::byte> buf,
+              completion_slot cb) {
+    return submit(job{._op = op::read,
+                      ._fd = fd,
+                      ._offset = offset,
+                      ._data = buf.data(),
+                      ._len = buf.size()},
+                  cb);
+  }
+
+  // write buf at offset, with the same lifetime requirements as read
+  closer write(int fd, off_t offset, std::span<const std::byte> buf,
+               completion_slot cb) {
+    return submit(job{._op = op::write,
+                      ._fd = fd,
+                      ._offset = offset,
+                      ._data = const_cast<std::byte*>(buf.data()),
+                      ._len = buf.size()},
+                  cb);
+  }
+
+  // read the whole file sequentially in chunks, delivered in order. the next
+  // chunks are read ahead (and hinted to the kernel) while the current one is
+  // processed. a chunk is only valid during the call. on_done receives 0 at
+  // end of file or the errno of a failed read.
+  closer read_stream(int fd, size_t chunk_size, chunk_slot on_chunk,
+                     stream_done_slot on_done) {
+    auto s = std::make_shared<stream>();
+    s->_fd = fd;
+    s->_chunk_size = std::max<size_t>(chunk_size, 1);
+    s->_on_chunk = on_chunk;
+    s->_on_done = on_done;
+    for (auto& b : s->_buffers) {
+      b._data = std::make_shared<std::vector<std::byte>>(s->_chunk_size);
+    }
+
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    auto id = _next_stream_id++;
+    _streams.emplace(id, s);
+    for (size_t i = 0; i < std::size(s->_buffers); ++i) {
+      issue_stream_read(id, s, i);
+    }
+
+    return closer([this, id] { cancel_stream(id); });
+  }
+
+  // operations submitted but not yet completed on the loop
+  size_t pending() const { return _callbacks.size(); }
+
+ private:
+  enum class op { read, write };
+
+  struct job {
+    op _op = op::read;
+    int _fd = -1;
+    off_t _offset = 0;
+    std::byte* _data = nullptr;
+    size_t _len = 0;
+    // bytes past this job worth hinting to the kernel, for streams
+    size_t _readahead = 0;
+    uint64_t _id = 0;
+    // keeps a stream buffer alive while the job runs
+    std::shared_ptr<std::vector<std::byte>> _keepalive;
+  };
+
+  struct completion {
+    uint64_t _id = 0;
+    file_result _result;
+  };
+
+  struct stream_buffer {
+    std::shared_ptr<std::vector<std::byte>> _data;
+    off_t _offset = 0;
+    bool _in_flight = false;
+    bool _ready = false;
+    file_result _result;
+  };
+
+  struct stream {
+    int _fd = -1;
+    size_t _chunk_size = 0;
+    chunk_slot _on_chunk;
+    stream_done_slot _on_done;
+    // double buffered: one chunk is delivered while the next is read
+    stream_buffer _buffers[2];
+    off_t _next_offset = 0;
+    size_t _deliver_idx = 0;
+    bool _finished = false;
+    closer _read_closers[2];
+  };
+
+  closer submit(job j, completion_slot cb) {
+    auto id = _next_id++;
+    j._id = id;
+    _callbacks.emplace(id, std::move(cb));
+    {
+      std::lock_guard lock(_mutex);
+      _jobs.emplace_back(std::move(j));
+    }
+    _cv.notify_one();
+    return closer([this, id] { _callbacks.erase(id); });
+  }
+
+  void work() {
+    for (;;) {
+      job j;
+      {
+        std::unique_lock lock(_mutex);
+        _cv.wait(lock, [this] { return _stopping || !_jobs.empty(); });
+        if (_stopping) return;
+        j = std::move(_jobs.front());
+        _jobs.pop_front();
+      }
+
+      if (j._readahead) {
+        ::posix_fadvise(j._fd, j._offset + j._len, j._readahead,
+                        POSIX_FADV_WILLNEED);
+      }
+
+      completion c{._id = j._id};
+      ssize_t n = 0;
+      do {
+        n = j._op == op::read ? ::pread(j._fd, j._data, j._len, j._offset)
+                              : ::pwrite(j._fd, j._data, j._len, j._offset);
+      } while (n < 0 && errno == EINTR);
+      if (n < 0) {
+        c._result.error = errno;
+      } else {
+        c._result.bytes = n;
+      }
+
+      bool wake = false;
+      {
+        std::lock_guard lock(_mutex);
+        wake = _completions.empty();
+        _completions.push_back(c);
+      }
+      // only the empty to non-empty edge needs a wakeup
+      if (wake) {
+        char b = 1;
+        [[maybe_unused]] auto res = ::write(_wake_write, &b, 1);
+      }
+    }
+  }
+
+  void dispatch() {
+    char buf[64];
+    while (::read(_wake_read, buf, sizeof(buf)) > 0) {
+    }
+
+    {
+      std::lock_guard lock(_mutex);
+      std::swap(_dispatching, _completions);
+    }
+
+    for (const auto& c : _dispatching) {
+      auto it = _callbacks.find(c._id);
+      if (it == _callbacks.end()) continue;  // cancelled
+      auto cb = std::move(it->second);
+      _callbacks.erase(it);
+      cb(c._result);
+    }
+    _dispatching.clear();
+  }
+
+  void issue_stream_read(uint64_t id, const std::shared_ptr<stream>& s,
+                         size_t idx) {
+    auto& b = s->_buffers[idx];
+    b._offset = s->_next_offset;
+    b._in_flight = true;
+    b._ready = false;
+    s->_next_offset += s->_chunk_size;
+
+    std::weak_ptr<stream> weak = s;
+    s->_read_closers[idx] = submit(
+        job{._op = op::read,
+            ._fd = s->_fd,
+            ._offset = b._offset,
+            ._data = b._data->data(),
+            ._len = s->_chunk_size,
+            ._readahead = 2 * s->_chunk_size,
+            ._keepalive = b._data},
+        [this, id, weak, idx](file_result r) {
+          if (auto s = weak.lock()) on_stream_read(id, s, idx, r);
+        });
+  }
+
+  void on_stream_read(uint64_t id, std::shared_ptr<stream> s, size_t idx,
+                      file_result r) {
+    s->_read_closers[idx] = closer();
+    auto& completed = s->_buffers[idx];
+    completed._in_flight = false;
+    completed._ready = true;
+    completed._result = r;
+
+    // deliver in file order, a later chunk may complete first
+    while (!s->_finished) {
+      auto& b = s->_buffers[s->_deliver_idx];
+      if (!b._ready) return;
+      b._ready = false;
+
+      if (b._result.error || b._result.bytes == 0) {
+        finish_stream(id, s, b._result.error);
+        return;
+      }
+
+      s->_on_chunk(
+          std::span<const std::byte>(b._data->data(), b._result.bytes));
+      if (!_streams.contains(id)) return;  // cancelled from the slot
+
+      if (b._result.bytes < s->_chunk_size) {
+        finish_stream(id, s, 0);
+        return;
+      }
+
+      issue_stream_read(id, s, s->_deliver_idx);
+      s->_deliver_idx = (s->_deliver_idx + 1) % 2;
+    }
+  }
+
+  void finish_stream(uint64_t id, const std::shared_ptr<stream>& s, int err) {
+    s->_finished = true;
+    _streams.erase(id);
+    s->_on_done(err);
+  }
+
+  void cancel_stream(uint64_t id) {
+    auto it = _streams.find(id);
+    if (it == _streams.end()) return;
+    for (auto& c : it->second->_read_closers) c.close();
+    _streams.erase(it);
+  }
+
+  loop<clock>& _loop;
+  int _wake_read = -1;
+  int _wake_write = -1;
+  closer _wake_closer;
+
+  // loop thread only
+  uint64_t _next_id = 1;
+  std::unordered_map<uint64_t, completion_slot> _callbacks;
+  uint64_t _next_stream_id = 1;
+  std::unordered_map<uint64_t, std::shared_ptr<stream>> _streams;
+  std::vector<completion> _dispatching;
+
+  // shared with the workers
+  std::mutex _mutex;
+  std::condition_variable _cv;
+  bool _stopping = false;
+  std::deque<job> _jobs;
+  std::vector<completion> _completions;
+  std::vector<std::thread> _workers;
+};
+
+}  // namespace hula
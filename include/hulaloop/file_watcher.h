@@ -0,0 +1,367 @@
+#pragma once
+
+#include "loop.h"
+#include "signal.h"
+#include "sys.h"
+
+#if !defined(_HULA_LINUX)
+#error "hula::file_watcher requires linux (inotify)"
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace hula {
+
+enum class file_event {
+  created,
+  modified,
+  // another file was renamed over the path, e.g. an atomic replace
+  replaced,
+  removed,
+  // events were lost, because the kernel queue overflowed or a new directory
+  // couldn't be watched (e.g. out of watches), rescan everything
+  overflow,
+};
+
+struct file_change {
+  std::string path;
+  file_event event = file_event::modified;
+};
+
+// watches files and directories with inotify on the loop. the inotify fd is
+// drained with large reads and bursts of events per path are coalesced into
+// one change: a path is delivered as soon as its writer closes it or a file
+// is renamed over it, otherwise once it has been quiet for quiet_period.
+// files are watched through their directory so replacing them by rename is
+// seen.
+template <class Clock = std::chrono::steady_clock>
+class file_watcher {
+ public:
+  using clock = Clock;
+  using change_signal = signal<file_change>;
+
+  struct options {
+    // how long a path must be quiet before changes not ending in a close or
+    // rename are delivered
+    typename clock::duration quiet_period = std::chrono::milliseconds(100);
+    // bytes per read of the inotify fd
+    size_t read_size = 64 * 1024;
+  };
+
+  explicit file_watcher(loop<clock>& l) : file_watcher(l, options{}) {}
+
+  explicit file_watcher(loop<clock>& l, options opts)
+      : _loop(l), _options(opts) {
+    _fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (_fd < 0) fail("inotify_init1");
+    _buffer.resize(std::max(_options.read_size,
+                            sizeof(inotify_event) + NAME_MAX + 1));
+    _closer = _loop.add_fd(_fd, fd_slots{.readable = [this](int) { drain(); }},
+                           fd_events::read);
+  }
+
+  ~file_watcher() {
+    _closer.close();
+    if (_fd >= 0) ::close(_fd);
+  }
+
+  file_watcher(const file_watcher&) = delete;
+  file_watcher& operator=(const file_watcher&) = delete;
+
+  // watch a single file, which need not exist yet
+  void watch_file(const std::string& path) {
+    std::filesystem::path p(path);
+    auto& dir = add_dir(p.parent_path().empty() ? "." : p.parent_path());
+    dir._names.insert(p.filename());
+  }
+
+  // watch every entry of a directory, and with recursive its subdirectories,
+  // including those created later
+  void watch_dir(const std::string& path, bool recursive = false) {
+    auto& dir = add_dir(path);
+    dir._all = true;
+    dir._recursive = dir._recursive || recursive;
+    if (recursive) add_subdirs(dir._path, false);
+  }
+
+  // stop watching a path given to watch_file or watch_dir
+  void unwatch(const std::string& path) {
+    std::filesystem::path p(path);
+    std::string clean = p.lexically_normal().string();
+    while (clean.size() > 1 && clean.back() == '/') clean.pop_back();
+
+    if (auto it = _by_path.find(clean); it != _by_path.end()) {
+      const bool recursive = _dirs.at(it->second)._recursive;
+      std::vector<int> wds{it->second};
+      if (recursive) {
+        for (auto& [wd, dir] : _dirs) {
+          if (dir._path.starts_with(clean + "/")) wds.push_back(wd);
+        }
+      }
+      for (int wd : wds) remove_watch(wd);
+      return;
+    }
+
+    auto parent = p.parent_path().empty() ? std::filesystem::path(".")
+                                          : p.parent_path();
+    auto it = _by_path.find(parent.lexically_normal().string());
+    if (it == _by_path.end()) return;
+    auto& dir = _dirs.at(it->second);
+    dir._names.erase(p.filename());
+    if (!dir._all && dir._names.empty()) remove_watch(it->second);
+  }
+
+  // called for each coalesced change
+  closer connect(change_signal::slot_type s) { return _signal.connect(s); }
+
+  // called with all the changes delivered at once
+  closer connect_batch(change_signal::batch_slot_type s) {
+    return _signal.connect_batch(s);
+  }
+
+  // directories with an inotify watch
+  size_t watches() const { return _dirs.size(); }
+
+ private:
+  static constexpr uint32_t k_dir_mask =
+      IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVED_TO |
+      IN_MOVED_FROM | IN_DELETE | IN_ONLYDIR;
+
+  struct watched_dir {
+    std::string _path;
+    // every entry, or only those in _names
+    bool _all = false;
+    bool _recursive = false;
+    std::unordered_set<std::string> _names;
+  };
+
+  struct pending_change {
+    file_event _event = file_event::modified;
+    typename clock::time_point _deliver_at;
+  };
+
+  [[noreturn]] void fail(const std::string& what) {
+    throw std::runtime_error("hula::file_watcher => " + what +
+                             " failed: " + std::strerror(errno));
+  }
+
+  // for the public watch calls
+  watched_dir& add_dir(const std::filesystem::path& path) {
+    watched_dir* dir = try_add_dir(path);
+    if (!dir) fail("watch " + path.string());
+    return *dir;
+  }
+
+  // nullptr with errno set if the directory can't be watched
+  watched_dir* try_add_dir(const std::filesystem::path& path) {
+    std::string clean = path.lexically_normal().string();
+    while (clean.size() > 1 && clean.back() == '/') clean.pop_back();
+    int wd = ::inotify_add_watch(_fd, clean.c_str(), k_dir_mask);
+    if (wd < 0) return nullptr;
+    auto& dir = _dirs[wd];
+    if (dir._path.empty()) {
+      dir._path = clean;
+      _by_path[clean] = wd;
+    }
+    return &dir;
+  }
+
+  // a directory which appeared during drain couldn't be watched. one already
+  // removed or replaced again is of no interest, otherwise its changes will
+  // be missed and listeners are told to rescan. nothing is thrown out of the
+  // loop.
+  void add_failed() {
+    if (errno == ENOENT || errno == ENOTDIR) return;
+    queue(std::string(), file_event::overflow, true);
+  }
+
+  // watches the subdirectories of a recursively watched directory. during
+  // drain, for a directory which just appeared, files created before its
+  // watch existed are reported as created and failures don't throw.
+  void add_subdirs(const std::string& root, bool in_drain) {
+    std::error_code ec;
+    std::filesystem::recursive_directory_iterator it(
+        root, std::filesystem::directory_options::skip_permission_denied, ec);
+    for (; !ec && it != std::filesystem::recursive_directory_iterator();
+         it.increment(ec)) {
+      if (it->is_directory(ec)) {
+        watched_dir* dir = in_drain ? try_add_dir(it->path())
+                                    : &add_dir(it->path());
+        if (!dir) {
+          add_failed();
+          continue;
+        }
+        dir->_all = true;
+        dir->_recursive = true;
+      } else if (in_drain) {
+        queue(it->path().lexically_normal().string(), file_event::created,
+              true);
+      }
+    }
+  }
+
+  void remove_watch(int wd) {
+    auto it = _dirs.find(wd);
+    if (it == _dirs.end()) return;
+    ::inotify_rm_watch(_fd, wd);
+    _by_path.erase(it->second._path);
+    _dirs.erase(it);
+  }
+
+  void drain() {
+    for (;;) {
+      auto n = ::read(_fd, _buffer.data(), _buffer.size());
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        return;
+      }
+      for (size_t off = 0; off < static_cast<size_t>(n);) {
+        inotify_event ev;
+        std::memcpy(&ev, _buffer.data() + off, sizeof(ev));
+        const char* name =
+            reinterpret_cast<const char*>(_buffer.data() + off + sizeof(ev));
+        handle(ev, ev.len ? std::string(name) : std::string());
+        off += sizeof(ev) + ev.len;
+      }
+      // a short read means the queue is empty
+      if (static_cast<size_t>(n) + sizeof(inotify_event) + NAME_MAX + 1 <=
+          _buffer.size()) {
+        return;
+      }
+    }
+  }
+
+  void handle(const inotify_event& ev, const std::string& name) {
+    if (ev.mask & IN_Q_OVERFLOW) {
+      queue(std::string(), file_event::overflow, true);
+      return;
+    }
+    if (ev.mask & IN_IGNORED) {
+      // the directory is gone, or was unwatched
+      if (auto it = _dirs.find(ev.wd); it != _dirs.end()) {
+        _by_path.erase(it->second._path);
+        _dirs.erase(it);
+      }
+      return;
+    }
+
+    auto it = _dirs.find(ev.wd);
+    if (it == _dirs.end() || name.empty()) return;
+    const auto& dir = it->second;
+    if (!dir._all && !dir._names.contains(name)) return;
+    std::string path = dir._path + "/" + name;
+
+    if (ev.mask & IN_ISDIR) {
+      if (dir._recursive && (ev.mask & (IN_CREATE | IN_MOVED_TO))) {
+        watched_dir* sub = try_add_dir(path);
+        if (!sub) return add_failed();
+        sub->_all = true;
+        sub->_recursive = true;
+        add_subdirs(path, true);
+      } else if (ev.mask & (IN_DELETE | IN_MOVED_FROM)) {
+        unwatch(path);
+      }
+      return;
+    }
+
+    if (ev.mask & IN_MOVED_TO) {
+      queue(path, file_event::replaced, true);
+    } else if (ev.mask & (IN_DELETE | IN_MOVED_FROM)) {
+      queue(path, file_event::removed, false);
+    } else if (ev.mask & IN_CREATE) {
+      queue(path, file_event::created, false);
+    } else if (ev.mask & IN_CLOSE_WRITE) {
+      queue(path, file_event::modified, true);
+    } else {
+      queue(path, file_event::modified, false);
+    }
+  }
+
+  // merges an event into the path's pending change. complete changes are
+  // delivered this cycle, others after the quiet period.
+  void queue(const std::string& path, file_event event, bool complete) {
+    auto now = clock::now();
+    auto [it, inserted] = _pending.try_emplace(path);
+    auto& p = it->second;
+    if (inserted) {
+      p._event = event;
+    } else {
+      p._event = merge(p._event, event);
+    }
+    p._deliver_at = complete ? now : now + _options.quiet_period;
+    arm(p._deliver_at);
+  }
+
+  static file_event merge(file_event before, file_event now) {
+    if (now == file_event::modified &&
+        (before == file_event::created || before == file_event::replaced)) {
+      return before;
+    }
+    if (before == file_event::removed && now == file_event::created) {
+      return file_event::replaced;
+    }
+    return now;
+  }
+
+  void arm(typename clock::time_point at) {
+    if (_sweep_closer && _sweep_at <= at) return;
+    _sweep_at = at;
+    auto fire_in = std::max(at - clock::now(), typename clock::duration{});
+    _sweep_closer = _loop.schedule(fire_in, [this] { sweep(); });
+  }
+
+  void sweep() {
+    _sweep_closer = closer();
+    auto now = clock::now();
+    _ready.clear();
+    auto next = clock::time_point::max();
+    for (auto it = _pending.begin(); it != _pending.end();) {
+      if (it->second._deliver_at <= now) {
+        _ready.push_back(file_change{it->first, it->second._event});
+        it = _pending.erase(it);
+      } else {
+        next = std::min(next, it->second._deliver_at);
+        ++it;
+      }
+    }
+    if (next != clock::time_point::max()) arm(next);
+    if (_ready.empty()) return;
+
+    std::sort(_ready.begin(), _ready.end(),
+              [](const file_change& a, const file_change& b) {
+                return a.path < b.path;
+              });
+    _signal.fire_batch(_ready);
+  }
+
+  loop<clock>& _loop;
+  options _options;
+  int _fd = -1;
+  closer _closer;
+  std::vector<std::byte> _buffer;
+
+  std::unordered_map<int, watched_dir> _dirs;
+  std::unordered_map<std::string, int> _by_path;
+
+  std::unordered_map<std::string, pending_change> _pending;
+  std::vector<file_change> _ready;
+  typename clock::time_point _sweep_at;
+  closer _sweep_closer;
+
+  change_signal _signal;
+};
+
+}  // namespace hula
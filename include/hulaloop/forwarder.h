@@ -0,0 +1,447 @@
+#pragma once
+
+#include "loop.h"
+#include "signal.h"
+#include "sigpipe.h"
+#include "sys.h"
+
+#if !defined(_HULA_LINUX)
+#error "hula::forwarder requires linux (splice/sendfile)"
+#endif
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace hula {
+
+// how a forwarder moves bytes in one direction
+enum class transfer {
+  splice,    // kernel pipe in between, no copies to user space
+  sendfile,  // regular file to any fd
+  copy,      // read/write through a user space buffer
+};
+
+// moves bytes between two descriptors on the loop. the forwarder registers
+// both fds itself (they must not be registered elsewhere) and toggles their
+// interest to apply backpressure: a source is only read while there is room
+// to buffer what it produces.
+// a peer which stops reading, e.g. closes, ends the direction towards it;
+// writes to it fail with EPIPE rather than raising SIGPIPE.
+// at least one fd must be pollable, files are only read or written as the
+// other side allows. the fds remain owned by the caller.
+template <class Clock = std::chrono::steady_clock>
+class forwarder {
+ public:
+  using clock = Clock;
+  // called once both directions reached eof (0) or on the first error (errno)
+  using closed_slot = slot<int, struct forwarder_closed_slot_tag>;
+
+  struct options {
+    // also forward b to a
+    bool bidirectional = true;
+    // bytes per syscall in copy and sendfile mode
+    size_t chunk_size = 64 * 1024;
+    // skip splice and sendfile, e.g. for comparison
+    bool force_copy = false;
+  };
+
+  struct stats {
+    uint64_t bytes = 0;
+    uint64_t syscalls = 0;
+  };
+
+  explicit forwarder(loop<clock>& l, int a, int b, closed_slot on_closed)
+      : forwarder(l, a, b, on_closed, options{}) {}
+
+  explicit forwarder(loop<clock>& l, int a, int b, closed_slot on_closed,
+                     options opts)
+      : _loop(l), _on_closed(on_closed), _options(opts) {
+    _endpoints[0]._fd = a;
+    _endpoints[1]._fd = b;
+    for (auto& ep : _endpoints) {
+      struct stat st{};
+      const bool known = ::fstat(ep._fd, &st) == 0;
+      ep._pollable = !(known && S_ISREG(st.st_mode));
+      ep._socket = known && S_ISSOCK(st.st_mode);
+    }
+    // nothing would ever drive the transfer
+    if (!_endpoints[0]._pollable && !_endpoints[1]._pollable) {
+      throw std::invalid_argument(
+          "hula::forwarder => two regular files, nothing to poll");
+    }
+
+    _directions[0]._src = 0;
+    _directions[0]._dst = 1;
+    _directions[1]._src = 1;
+    _directions[1]._dst = 0;
+    _directions[1]._done = !_options.bidirectional;
+
+    for (auto& d : _directions) {
+      if (!d._done) setup(d);
+    }
+
+    for (auto& ep : _endpoints) {
+      if (!ep._pollable) continue;
+      set_nonblocking(ep._fd);
+      ep._events = wanted_events(ep);
+      ep._closer =
+          _loop.add_fd(ep._fd,
+                       fd_slots{
+                           .readable = [this, &ep](int) { on_readable(ep); },
+                           .writable = [this, &ep](int) { on_writable(ep); },
+                           .error = [this, &ep](int) { on_hangup(ep); },
+                       },
+                       ep._events);
+    }
+  }
+
+  ~forwarder() { stop(); }
+
+  forwarder(const forwarder&) = delete;
+  forwarder& operator=(const forwarder&) = delete;
+
+  // deregister from the loop without calling the closed slot
+  void stop() {
+    for (auto& ep : _endpoints) ep._closer.close();
+    for (auto& d : _directions) {
+      for (int& p : d._pipe) {
+        if (p >= 0) ::close(p);
+        p = -1;
+      }
+    }
+    _stopped = true;
+  }
+
+  bool stopped() const { return _stopped; }
+
+  stats a_to_b() const { return _directions[0]._stats; }
+  stats b_to_a() const { return _directions[1]._stats; }
+
+  stats total() const {
+    return stats{
+        .bytes = a_to_b().bytes + b_to_a().bytes,
+        .syscalls = a_to_b().syscalls + b_to_a().syscalls,
+    };
+  }
+
+  transfer a_to_b_transfer() const { return _directions[0]._transfer; }
+  transfer b_to_a_transfer() const { return _directions[1]._transfer; }
+
+ private:
+  struct endpoint {
+    int _fd = -1;
+    bool _pollable = true;
+    bool _socket = false;
+    // dropped from the loop after a hangup
+    bool _hungup = false;
+    fd_events _events = fd_events::none;
+    closer _closer;
+  };
+
+  struct direction {
+    size_t _src = 0;
+    size_t _dst = 0;
+    transfer _transfer = transfer::splice;
+    int _pipe[2] = {-1, -1};
+    size_t _capacity = 0;
+    // bytes held in the pipe or buffer
+    size_t _buffered = 0;
+    std::vector<char> _buffer;
+    size_t _buffer_offset = 0;
+    off_t _file_offset = 0;
+    bool _eof = false;
+    bool _done = false;
+    stats _stats;
+  };
+
+  void setup(direction& d) {
+    const bool src_is_file = !_endpoints[d._src]._pollable;
+    if (src_is_file && !_options.force_copy) {
+      d._transfer = transfer::sendfile;
+      d._capacity = 0;
+      return;
+    }
+
+    if (!_options.force_copy &&
+        ::pipe2(d._pipe, O_NONBLOCK | O_CLOEXEC) == 0) {
+      d._transfer = transfer::splice;
+      int size = ::fcntl(d._pipe[0], F_GETPIPE_SZ);
+      d._capacity = size > 0 ? size : 64 * 1024;
+      return;
+    }
+
+    use_copy(d);
+  }
+
+  void use_copy(direction& d) {
+    d._transfer = transfer::copy;
+    d._capacity = std::max(_options.chunk_size, d._buffered);
+    d._buffer.resize(d._capacity);
+    d._buffer_offset = 0;
+
+    // move anything already spliced into the pipe into the buffer
+    size_t moved = 0;
+    while (moved < d._buffered) {
+      auto n =
+          ::read(d._pipe[0], d._buffer.data() + moved, d._buffered - moved);
+      d._stats.syscalls++;
+      if (n <= 0) break;
+      moved += n;
+    }
+    d._buffered = moved;
+
+    for (int& p : d._pipe) {
+      if (p >= 0) ::close(p);
+      p = -1;
+    }
+  }
+
+  fd_events wanted_events(const endpoint& ep) const {
+    const size_t idx = &ep - _endpoints.data();
+    int events = 0;
+    for (const auto& d : _directions) {
+      if (d._done) continue;
+      if (d._src == idx && !d._eof && d._buffered < d._capacity) {
+        events |= POLLIN;
+      }
+      if (d._dst == idx &&
+          (d._buffered > 0 ||
+           (!polled(_endpoints[d._src]) && !d._eof))) {
+        events |= POLLOUT;
+      }
+    }
+    return static_cast<fd_events>(events);
+  }
+
+  void on_readable(endpoint& ep) {
+    const size_t idx = &ep - _endpoints.data();
+    for (auto& d : _directions) {
+      if (_stopped) return;
+      if (d._done || d._src != idx) continue;
+      fill(d);
+      if (d._buffered > 0) drain(d);
+      finish_if_done(d);
+    }
+    update_interest();
+  }
+
+  void on_writable(endpoint& ep) {
+    const size_t idx = &ep - _endpoints.data();
+    for (auto& d : _directions) {
+      if (_stopped) return;
+      if (d._done || d._dst != idx) continue;
+      if (!polled(_endpoints[d._src])) fill(d);
+      drain(d);
+      finish_if_done(d);
+    }
+    update_interest();
+  }
+
+  // errors surface from the next io attempt. a hangup stays reported on
+  // every poll, so once what the endpoint still holds has been read it is
+  // dropped from the loop: nothing more can be written to it, and reading
+  // the rest follows the other endpoint's writability, as for a file.
+  void on_hangup(endpoint& ep) {
+    const size_t idx = &ep - _endpoints.data();
+    for (auto& d : _directions) {
+      if (_stopped) return;
+      if (d._done) continue;
+      if (d._src == idx) {
+        // a file destination never polls, so take everything now
+        uint64_t before = 0;
+        do {
+          before = d._stats.bytes;
+          fill(d);
+          drain(d);
+        } while (!_stopped && !d._done && !_endpoints[d._dst]._pollable &&
+                 d._stats.bytes != before);
+      } else {
+        drain(d);
+      }
+      finish_if_done(d);
+    }
+    if (_stopped) return;
+
+    ep._hungup = true;
+    ep._closer.close();
+    for (auto& d : _directions) {
+      if (_stopped) return;
+      if (!d._done && d._dst == idx) finish(d);
+    }
+    update_interest();
+  }
+
+  void fill(direction& d) {
+    if (d._eof || _stopped) return;
+    const int src = _endpoints[d._src]._fd;
+
+    ssize_t n = 0;
+    switch (d._transfer) {
+      case transfer::sendfile:
+        return;  // the file is read by sendfile itself
+      case transfer::splice: {
+        if (d._buffered >= d._capacity) return;
+        n = ::splice(src, nullptr, d._pipe[1], nullptr,
+                     d._capacity - d._buffered,
+                     SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        d._stats.syscalls++;
+        if (n < 0 && errno == EINVAL) {
+          // the source doesn't support splicing
+          use_copy(d);
+          return fill(d);
+        }
+        break;
+      }
+      case transfer::copy: {
+        if (d._buffered == 0) d._buffer_offset = 0;
+        size_t end = d._buffer_offset + d._buffered;
+        if (end >= d._buffer.size()) return;
+        n = ::read(src, d._buffer.data() + end, d._buffer.size() - end);
+        d._stats.syscalls++;
+        break;
+      }
+    }
+
+    if (n > 0) {
+      d._buffered += n;
+    } else if (n == 0) {
+      d._eof = true;
+    } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+      fail(errno);
+    }
+  }
+
+  void drain(direction& d) {
+    if (_stopped) return;
+    const int dst = _endpoints[d._dst]._fd;
+
+    ssize_t n = 0;
+    switch (d._transfer) {
+      case transfer::sendfile: {
+        n = without_sigpipe([&] {
+          return ::sendfile(dst, _endpoints[d._src]._fd, &d._file_offset,
+                            _options.chunk_size);
+        });
+        d._stats.syscalls++;
+        if (n == 0) d._eof = true;
+        if (n < 0 && (errno == EINVAL || errno == ENOSYS)) {
+          use_copy(d);
+          fill(d);
+          return drain(d);
+        }
+        if (n > 0) d._stats.bytes += n;
+        break;
+      }
+      case transfer::splice: {
+        if (d._buffered == 0) return;
+        n = without_sigpipe([&] {
+          return ::splice(d._pipe[0], nullptr, dst, nullptr, d._buffered,
+                          SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        });
+        d._stats.syscalls++;
+        if (n < 0 && errno == EINVAL) {
+          // the destination doesn't support splicing
+          use_copy(d);
+          return drain(d);
+        }
+        if (n > 0) {
+          d._buffered -= n;
+          d._stats.bytes += n;
+        }
+        break;
+      }
+      case transfer::copy: {
+        if (d._buffered == 0) return;
+        const char* data = d._buffer.data() + d._buffer_offset;
+        if (_endpoints[d._dst]._socket) {
+          n = ::send(dst, data, d._buffered, MSG_NOSIGNAL);
+        } else {
+          n = without_sigpipe([&] { return ::write(dst, data, d._buffered); });
+        }
+        d._stats.syscalls++;
+        if (n > 0) {
+          d._buffered -= n;
+          d._buffer_offset += n;
+          d._stats.bytes += n;
+        }
+        break;
+      }
+    }
+
+    if (n < 0 && errno == EPIPE) {
+      // the destination stopped reading, what is left can't be delivered
+      finish(d);
+    } else if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK &&
+               errno != EINTR) {
+      fail(errno);
+    }
+  }
+
+  void finish_if_done(direction& d) {
+    if (_stopped || d._done || !d._eof || d._buffered > 0) return;
+    // propagate the eof, fails harmlessly for non sockets
+    ::shutdown(_endpoints[d._dst]._fd, SHUT_WR);
+    finish(d);
+  }
+
+  void finish(direction& d) {
+    d._done = true;
+    for (const auto& other : _directions) {
+      if (!other._done) return;
+    }
+    stop();
+    notify_closed(0);
+  }
+
+  void update_interest() {
+    if (_stopped) return;
+    for (auto& ep : _endpoints) {
+      if (!polled(ep)) continue;
+      auto events = wanted_events(ep);
+      if (events == ep._events) continue;
+      ep._events = events;
+      _loop.update_fd(ep._fd, events);
+    }
+  }
+
+  void fail(int err) {
+    stop();
+    notify_closed(err);
+  }
+
+  // deferred so the slot may safely destroy the forwarder
+  void notify_closed(int err) {
+    _notify_closer = _loop.schedule([this, err] { _on_closed(err); });
+  }
+
+  static bool polled(const endpoint& ep) {
+    return ep._pollable && !ep._hungup;
+  }
+
+  static void set_nonblocking(int fd) {
+    int flags = ::fcntl(fd, F_GETFL);
+    if (flags >= 0 && !(flags & O_NONBLOCK)) {
+      ::fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    }
+  }
+
+  loop<clock>& _loop;
+  closed_slot _on_closed;
+  options _options;
+  std::array<endpoint, 2> _endpoints;
+  std::array<direction, 2> _directions;
+  bool _stopped = false;
+  closer _notify_closer;
+};
+
+}  // namespace hula
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace hula {
+
+// the phases of a single loop cycle
+enum class loop_phase : uint8_t {
+  idle,
+  poll,
+  fd_dispatch,
+  timers,
+  signals,
+  idle_tasks,
+};
+
+inline const char* to_string(loop_phase p) {
+  switch (p) {
+    case loop_phase::idle:
+      return "idle";
+    case loop_phase::poll:
+      return "poll";
+    case loop_phase::fd_dispatch:
+      return "fd_dispatch";
+    case loop_phase::timers:
+      return "timers";
+    case loop_phase::signals:
+      return "signals";
+    case loop_phase::idle_tasks:
+      return "idle_tasks";
+  }
+  return "unknown";
+}
+
+// snapshot of what the loop is currently doing
+struct heartbeat_state {
+  uint64_t _seq = 0;
+  std::chrono::steady_clock::time_point _since;
+  loop_phase _phase = loop_phase::idle;
+  // fd, timer id or signal number depending on the phase, -1 if none
+  int64_t _id = -1;
+  const char* _label = nullptr;
+};
+
+// written by the loop thread at each phase change, read from any other thread.
+// uses a sequence lock so readers never block the loop.
+class heartbeat {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  void beat(loop_phase phase, int64_t id = -1) {
+    auto seq = _seq.load(std::memory_order_relaxed);
+    _seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    _since.store(clock::now().time_since_epoch().count(),
+                 std::memory_order_relaxed);
+    _phase.store(phase, std::memory_order_relaxed);
+    _id.store(id, std::memory_order_relaxed);
+    _label.store(nullptr, std::memory_order_relaxed);
+
+    _seq.store(seq + 2, std::memory_order_release);
+  }
+
+  // attach a label to the current registration, cleared on the next beat.
+  // the string must outlive the registration.
+  void annotate(const char* label) {
+    _label.store(label, std::memory_order_relaxed);
+  }
+
+  heartbeat_state read() const {
+    heartbeat_state s;
+    uint64_t seq_after = 0;
+    do {
+      s._seq = _seq.load(std::memory_order_acquire);
+      if (s._seq & 1) continue;  // write in progress
+
+      s._since = clock::time_point(
+          clock::duration(_since.load(std::memory_order_relaxed)));
+      s._phase = _phase.load(std::memory_order_relaxed);
+      s._id = _id.load(std::memory_order_relaxed);
+      s._label = _label.load(std::memory_order_relaxed);
+
+      std::atomic_thread_fence(std::memory_order_acquire);
+      seq_after = _seq.load(std::memory_order_relaxed);
+    } while ((s._seq & 1) || s._seq != seq_after);
+    return s;
+  }
+
+ private:
+  std::atomic<uint64_t> _seq{0};
+  std::atomic<clock::rep> _since{0};
+  std::atomic<loop_phase> _phase{loop_phase::idle};
+  std::atomic<int64_t> _id{-1};
+  std::atomic<const char*> _label{nullptr};
+};
+
+}  // namespace hula
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <limits>
+
+namespace hula {
+
+// fixed size log-linear histogram of non-negative values, e.g. latencies in
+// nanoseconds. values are grouped by power of two, each split into 16 linear
+// sub buckets, so recorded values keep about 6% precision. recording is a
+// couple of instructions and never allocates.
+class histogram {
+ public:
+  void record(int64_t value) {
+    if (value < 0) value = 0;
+    _buckets[bucket_of(static_cast<uint64_t>(value))]++;
+    _count++;
+    _sum += value;
+    _min = std::min(_min, value);
+    _max = std::max(_max, value);
+  }
+
+  uint64_t count() const { return _count; }
+  int64_t min() const { return _count ? _min : 0; }
+  int64_t max() const { return _max; }
+  double mean() const {
+    return _count ? static_cast<double>(_sum) / _count : 0;
+  }
+
+  // upper bound of the bucket holding the given quantile, 0 <= q <= 1
+  int64_t percentile(double q) const {
+    if (_count == 0) return 0;
+    auto rank = static_cast<uint64_t>(q * static_cast<double>(_count - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < k_buckets; ++i) {
+      seen += _buckets[i];
+      if (seen >= rank) return std::min(upper_bound_of(i), _max);
+    }
+    return _max;
+  }
+
+  void merge(const histogram& o) {
+    for (size_t i = 0; i < k_buckets; ++i) _buckets[i] += o._buckets[i];
+    _count += o._count;
+    _sum += o._sum;
+    _min = std::min(_min, o._min);
+    _max = std::max(_max, o._max);
+  }
+
+  void reset() { *this = histogram{}; }
+
+ private:
+  static constexpr int k_sub_bits = 4;
+  static constexpr uint64_t k_sub = uint64_t{1} << k_sub_bits;
+  static constexpr size_t k_buckets = (64 - k_sub_bits + 1) * k_sub;
+
+  // values below k_sub get a bucket each, above that the top k_sub_bits + 1
+  // bits select the bucket
+  static size_t bucket_of(uint64_t v) {
+    if (v < k_sub) return v;
+    int shift = std::bit_width(v) - k_sub_bits - 1;
+    return (shift + 1) * k_sub + ((v >> shift) - k_sub);
+  }
+
+  static int64_t upper_bound_of(size_t bucket) {
+    if (bucket < k_sub) return bucket;
+    int shift = static_cast<int>(bucket / k_sub) - 1;
+    uint64_t sub = bucket % k_sub + k_sub;
+    uint64_t upper = ((sub + 1) << shift) - 1;
+    return upper > static_cast<uint64_t>(std::numeric_limits<int64_t>::max())
+               ? std::numeric_limits<int64_t>::max()
+               : static_cast<int64_t>(upper);
+  }
+
+  std::array<uint64_t, k_buckets> _buckets{};
+  uint64_t _count = 0;
+  int64_t _sum = 0;
+  int64_t _min = std::numeric_limits<int64_t>::max();
+  int64_t _max = 0;
+};
+
+}  // namespace hula
@@ -0,0 +1,192 @@
+#pragma once
+
+#include "loop.h"
+#include "signal.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace hula {
+
+// expires tracked entries (e.g. connections) which were not touched for a
+// given timeout. touching an entry only stores a timestamp: deadlines are
+// kept in a coarse timing wheel driven by a single loop timer and are only
+// refreshed lazily, when the sweep reaches an entry that was touched since it
+// was filed. an entry is expired between timeout and timeout + granularity
+// after its last touch.
+template <class Clock = std::chrono::steady_clock>
+class idle_timeouts {
+ public:
+  using clock = Clock;
+  // receives the keys of the entries expired by a sweep, which are no longer
+  // tracked. the slot may add, touch and remove entries, or destroy this
+  // object.
+  using expired_slot =
+      slot<std::span<const uint64_t>, struct idle_expired_slot_tag>;
+
+  // identifies a tracked entry. stale handles, default constructed ones and
+  // those of another idle_timeouts are ignored
+  struct handle {
+    uint32_t index = 0;
+    uint32_t generation = 0;
+  };
+
+  struct options {
+    // sweep interval and expiry precision, defaults to timeout / 8
+    typename clock::duration granularity{};
+  };
+
+  explicit idle_timeouts(loop<clock>& l, typename clock::duration timeout,
+                         expired_slot on_expired)
+      : idle_timeouts(l, timeout, on_expired, options{}) {}
+
+  explicit idle_timeouts(loop<clock>& l, typename clock::duration timeout,
+                         expired_slot on_expired, options opts)
+      : _loop(l), _timeout(timeout), _on_expired(on_expired) {
+    using duration = typename clock::duration;
+    _granularity = opts.granularity.count() > 0
+                       ? opts.granularity
+                       : std::max(timeout / 8, duration{1});
+    _wheel.resize(_timeout / _granularity + 2);
+    _cursor = tick(clock::now());
+  }
+
+  idle_timeouts(const idle_timeouts&) = delete;
+  idle_timeouts& operator=(const idle_timeouts&) = delete;
+
+  // start tracking key, as if touched now
+  handle add(uint64_t key) {
+    uint32_t index;
+    if (!_free.empty()) {
+      index = _free.back();
+      _free.pop_back();
+    } else {
+      index = static_cast<uint32_t>(_entries.size());
+      _entries.emplace_back();
+    }
+
+    auto& e = _entries[index];
+    e._key = key;
+    e._last = clock::now();
+    e._active = true;
+    _size++;
+
+    handle h{index, e._generation};
+    file(h, e._last + _timeout);
+    if (!_sweep_closer) schedule_sweep();
+    return h;
+  }
+
+  // record activity, O(1)
+  void touch(handle h) { touch(h, clock::now()); }
+
+  // record activity at a timestamp the caller already has
+  void touch(handle h, typename clock::time_point now) {
+    if (!valid(h)) return;
+    _entries[h.index]._last = now;
+  }
+
+  // stop tracking, without calling the slot
+  void remove(handle h) {
+    if (!valid(h)) return;
+    release(h.index);
+    // the wheel drops the stale reference when it reaches it
+    if (_size == 0) _sweep_closer.close();
+  }
+
+  bool valid(handle h) const {
+    return h.index < _entries.size() &&
+           _entries[h.index]._generation == h.generation &&
+           _entries[h.index]._active;
+  }
+
+  size_t size() const { return _size; }
+
+  typename clock::duration timeout() const { return _timeout; }
+  typename clock::duration granularity() const { return _granularity; }
+
+ private:
+  struct entry {
+    typename clock::time_point _last{};
+    uint64_t _key = 0;
+    // from 1, so a default constructed handle matches nothing
+    uint32_t _generation = 1;
+    bool _active = false;
+  };
+
+  int64_t tick(typename clock::time_point t) const {
+    return t.time_since_epoch() / _granularity;
+  }
+
+  // file under the wheel slot of the given deadline. deadlines further away
+  // than the wheel spans land early, which only costs a re-file.
+  void file(handle h, typename clock::time_point deadline) {
+    _wheel[tick(deadline) % _wheel.size()].push_back(h);
+  }
+
+  void release(uint32_t index) {
+    auto& e = _entries[index];
+    e._active = false;
+    e._generation++;
+    _free.push_back(index);
+    _size--;
+  }
+
+  void schedule_sweep() {
+    _sweep_closer = _loop.schedule(_granularity, [this] { sweep(); });
+  }
+
+  void sweep() {
+    _sweep_closer = closer();
+    const auto now = clock::now();
+    const auto now_tick = tick(now);
+
+    // only complete ticks, every deadline filed there is <= now
+    const auto ticks = std::min<int64_t>(now_tick - _cursor, _wheel.size());
+    for (int64_t i = 0; i < ticks; ++i) {
+      auto& bucket = _wheel[(_cursor + i) % _wheel.size()];
+      _sweeping.swap(bucket);
+      for (auto h : _sweeping) {
+        if (!valid(h)) continue;
+        auto& e = _entries[h.index];
+        auto deadline = e._last + _timeout;
+        if (deadline <= now) {
+          _expired.push_back(e._key);
+          release(h.index);
+        } else {
+          file(h, deadline);  // touched since filed
+        }
+      }
+      _sweeping.clear();
+    }
+    _cursor = std::max(_cursor, now_tick);
+
+    if (_size > 0) schedule_sweep();
+    if (_expired.empty()) return;
+
+    // the slot may destroy us, nothing is touched after it returns
+    auto on_expired = _on_expired;
+    auto expired = std::move(_expired);
+    _expired.clear();
+    on_expired(std::span<const uint64_t>(expired));
+  }
+
+  loop<clock>& _loop;
+  typename clock::duration _timeout;
+  typename clock::duration _granularity;
+  expired_slot _on_expired;
+
+  std::vector<entry> _entries;
+  std::vector<uint32_t> _free;
+  size_t _size = 0;
+
+  std::vector<std::vector<handle>> _wheel;
+  int64_t _cursor = 0;
+  std::vector<handle> _sweeping;
+  std::vector<uint64_t> _expired;
+  closer _sweep_closer;
+};
+
+}  // namespace hula
@@ -1,7 +1,13 @@
 #pragma once
 
+#include "backend.h"
 #include "closer.h"
+#include "heartbeat.h"
+#include "histogram.h"
+#include "pollfd_scan.h"
+#include "probes.h"
 #include "signal.h"
+#include "trace.h"
 #include "unix_sig.h"
 
 #include <algorithm>
@@ -9,6 +15,8 @@
 #include <deque>
 #include <functional>
 #include <iterator>
+#include <optional>
+#include <span>
 #include <stdexcept>
 #include <string>
 #include <thread>
@@ -27,7 +35,12 @@ struct loop_test;
 struct fake_clock_loop_test;
 }  // namespace test
 
+template <class Clock>
+class closer_group;
+
 enum class fd_events {
+  // only errors and hangups are reported
+  none = 0,
   read = POLLIN,
   write = POLLOUT,
   read_write = POLLIN | POLLOUT
@@ -42,6 +55,21 @@ struct fd_slots {
   fd_slot error;
 };
 
+// a ready descriptor, as delivered to a ready_slot.
+// revents only contains the error bits and the events the fd was registered
+// for.
+struct ready_event {
+  int fd = -1;
+  short revents = 0;
+  void* user_data = nullptr;
+};
+
+// receives every ready batched descriptor of a cycle in a single call
+using ready_slot = slot<std::span<const ready_event>, struct ready_slot_tag>;
+
+// returned by an idle task: whether it finished or has more work to resume
+enum class idle_result { done, more };
+
 // basic event loop which handles polling file descriptors,
 // registering callbacks and other timing related functionality.
 template <typename Clock = std::chrono::steady_clock>
@@ -63,6 +91,14 @@ class loop {
 
   void stop() { _stopping = true; }
 
+  // runs a single cycle. returns false if the loop was stopped or has no
+  // more work to do.
+  bool run_once() {
+    _stopping = false;
+    do_cycle();
+    return !_stopping;
+  }
+
   // immediately called in the next cycle.
   // callback can be manually removed by calling cancel_callback(id).
   uint64_t post(slot<> cb) { return post(0ns, cb); }
@@ -75,13 +111,9 @@ class loop {
   // callback can be manually removed by calling cancel_callback(id).
   uint64_t post(clock::duration fire_in, slot<> cb) {
     auto id = _next_callback_id++;
-    auto fire_at = clock::now() + fire_in;
-
-    auto it = _callback_contexts.rbegin();
-    while (it != _callback_contexts.rend() && fire_at > it->_fire_at) it++;
-
-    _callback_contexts.insert(
-        it.base(), callback_context{._id = id, ._fire_at = fire_at, ._cb = cb});
+    insert_callback(callback_context{
+        ._id = id, ._fire_at = clock::now() + fire_in, ._cb = cb});
+    HULA_PROBE2(post, id, to_ns(fire_in));
 
     return id;
   }
@@ -93,36 +125,145 @@ class loop {
     return closer([=, this] { cancel_callback(id); });
   }
 
+  // like post, but does nothing if a callback posted with the same key is
+  // still pending, e.g. to flush a connection once at the end of the cycle.
+  // returns the id of the pending callback.
+  uint64_t post_once(uint64_t key, slot<> cb) {
+    return post_once(key, 0ns, cb);
+  }
+
+  // like post, but if a callback with the same key is pending only its
+  // deadline is moved, to whichever of the two is earlier. the pending
+  // callback keeps its slot and id.
+  uint64_t post_once(uint64_t key, clock::duration fire_in, slot<> cb) {
+    auto fire_at = clock::now() + fire_in;
+    auto it = _keyed_callbacks.find(key);
+    if (it != _keyed_callbacks.end() && cancelled(it->second)) {
+      _keyed_callbacks.erase(it);
+      it = _keyed_callbacks.end();
+    }
+    if (it == _keyed_callbacks.end()) {
+      auto id = _next_callback_id++;
+      insert_callback(callback_context{
+          ._id = id, ._fire_at = fire_at, ._cb = cb, ._key = key});
+      _keyed_callbacks.emplace(key, id);
+      HULA_PROBE2(post, id, to_ns(fire_in));
+      return id;
+    }
+
+    auto id = it->second;
+    auto ctx = find_callback(id);
+    if (fire_at < ctx->_fire_at) {
+      auto moved = std::move(*ctx);
+      _callback_contexts.erase(ctx);
+      moved._fire_at = fire_at;
+      insert_callback(std::move(moved));
+    }
+    return id;
+  }
+
+  closer schedule_once(uint64_t key, slot<> cb) {
+    return schedule_once(key, 0ns, cb);
+  }
+
+  // see post_once. closing the handle cancels the pending callback for the
+  // key, whoever scheduled it.
+  closer schedule_once(uint64_t key, clock::duration fire_in, slot<> cb) {
+    auto id = post_once(key, fire_in, cb);
+    return closer([=, this] { cancel_callback(id); });
+  }
+
+  // whether a callback posted with the key is pending
+  bool pending(uint64_t key) const {
+    auto it = _keyed_callbacks.find(key);
+    return it != _keyed_callbacks.end() && !cancelled(it->second);
+  }
+
+  // task called with a deadline by which it should return
+  using idle_slot = std::function<idle_result(typename clock::time_point)>;
+
+  // run a background task only while the loop would otherwise sleep, i.e. no
+  // fd needs writing and no callback is due before the next poll. each call
+  // gets at most budget, after which the task returns idle_result::more to
+  // be resumed in a later quiet period, so io is never delayed by more than
+  // one slice. a loop which never sleeps, e.g. with a poll interval of 0,
+  // still runs one slice every set_idle_starvation_limit cycles.
+  // can be cancelled with cancel_callback(id).
+  uint64_t post_idle(idle_slot task, clock::duration budget = 100us) {
+    auto id = _next_callback_id++;
+    _idle_tasks.push_back(
+        idle_task{._id = id, ._task = task, ._budget = budget});
+    return id;
+  }
+
+  // see post_idle. close the handle to cancel the task.
+  closer schedule_idle(idle_slot task, clock::duration budget = 100us) {
+    auto id = post_idle(task, budget);
+    return closer([=, this] { cancel_callback(id); });
+  }
+
   // cancels the callback with the given id if it exists.
   // safe to call with a non-existing callback id.
   void cancel_callback(uint64_t id) {
-    auto it = std::find_if(
-        _callback_contexts.begin(), _callback_contexts.end(),
-        [=](const callback_context& ctx) { return ctx._id == id; });
-    if (it == _callback_contexts.end()) return;
+    HULA_PROBE1(cancel_callback, id);
+    auto it = find_callback(id);
+    if (it == _callback_contexts.end()) {
+      cancel_idle(id);
+      return;
+    }
 
+    if (it->_key) _keyed_callbacks.erase(*it->_key);
     _callback_contexts.erase(it);
   }
 
+  // cancels many callbacks or idle tasks. during a cycle they are only
+  // skipped, and the callback table is swept once at the end of the cycle
+  // however many calls were made.
+  void cancel_callbacks(std::span<const uint64_t> ids) {
+    for (auto id : ids) {
+      HULA_PROBE1(cancel_callback, id);
+      _pending_cancellations.insert(id);
+    }
+    if (_pending_cancellations.contains(_running_idle)) {
+      _running_idle_cancelled = true;
+    }
+    if (!_in_cycle) handle_cancellations();
+  }
+
   // register a handler to a specific signal (e.g. kill, winsize change)
   closer connect_to_unix_signal(unix::sig s, unix::signal::slot_type sl) {
     unix::signal& sig = register_or_get_unix_signal(s);
     return sig.connect(sl);
   }
 
+  // queue delivery of a unix signal as though it had been raised.
+  // ignored if nothing is connected to the signal.
+  void queue_unix_signal(unix::sig s) {
+    if (_signal_handlers.contains(s)) _queued_unix_signals.push_back(s);
+  }
+
   // register a handler to the given fd (this will cause the loop to poll the
   // file descriptor). to stop polling the descriptor simply close the handle.
   closer add_fd(int fd, fd_slots slots, fd_events events) {
-    auto c = closer([=, this] { remove_fd(fd); });
-    if (_processing_fds) {
-      _pending_poll_additions.emplace_back(
-          pending_poll_addition{._fd = fd, ._slots = slots, ._events = events});
-      return c;
-    }
-    push_back_fd(fd, slots, events);
-    return c;
+    register_fd(fd_handler{._fd = fd, ._slots = slots, ._events = events});
+    return closer([=, this] { remove_fd(fd); });
+  }
+
+  // register the fd for batched dispatch. instead of calling per-fd slots,
+  // readiness of all batched fds is delivered to the ready slot at once, once
+  // per cycle, along with user_data. to stop polling simply close the handle.
+  closer add_fd_batched(int fd, void* user_data, fd_events events) {
+    register_fd(fd_handler{._fd = fd,
+                           ._events = events,
+                           ._user_data = user_data,
+                           ._batched = true});
+    return closer([=, this] { remove_fd(fd); });
   }
 
+  // set the slot which receives the ready events of batched fds.
+  // events remain valid only for the duration of the call.
+  void set_ready_slot(ready_slot s) { _ready_slot = s; }
+
   // change the desired events of the descriptor
   void update_fd(int fd, fd_events events) {
     auto it =
@@ -133,7 +274,7 @@ class loop {
       // might be pending
       auto pending_it = std::find_if(
           _pending_poll_additions.begin(), _pending_poll_additions.end(),
-          [=](const pending_poll_addition& ppa) { return ppa._fd == fd; });
+          [=](const fd_handler& fdh) { return fdh._fd == fd; });
       if (pending_it != _pending_poll_additions.end()) {
         pending_it->_events = events;
       }
@@ -147,6 +288,7 @@ class loop {
   }
 
   void remove_fd(int fd) {
+    HULA_PROBE1(remove_fd, fd);
     auto it =
         std::find_if(_fd_handlers.begin(), _fd_handlers.end(),
                      [=](const fd_handler& fdh) { return fdh._fd == fd; });
@@ -155,7 +297,7 @@ class loop {
       // might be pending
       auto pending_it = std::find_if(
           _pending_poll_additions.begin(), _pending_poll_additions.end(),
-          [=](const pending_poll_addition& ppa) { return ppa._fd == fd; });
+          [=](const fd_handler& fdh) { return fdh._fd == fd; });
       if (pending_it != _pending_poll_additions.end()) {
         _pending_poll_additions.erase(pending_it);
       }
@@ -164,7 +306,7 @@ class loop {
     if (_processing_fds) {
       // we can't remove right now so let's mark for cleanup
       auto& handler = *it;
-      if (!handler._active) _pending_poll_removals.insert(fd);
+      if (handler._active) _pending_poll_removals.insert(fd);
 
       handler._active = false;
       return;
@@ -176,38 +318,111 @@ class loop {
     _pollfds.erase(_pollfds.begin() + idx);
   }
 
+  // removes many fds. during a cycle they are only no longer dispatched,
+  // and the fd tables are swept once at the end of the cycle however many
+  // calls were made.
+  void remove_fds(std::span<const int> fds) {
+    for (int fd : fds) {
+      HULA_PROBE1(remove_fd, fd);
+      _pending_poll_removals.insert(fd);
+    }
+    if (!_pending_poll_additions.empty()) {
+      std::erase_if(_pending_poll_additions, [&](const fd_handler& fdh) {
+        return std::find(fds.begin(), fds.end(), fdh._fd) != fds.end();
+      });
+    }
+    if (!_in_cycle) sweep_fd_removals();
+  }
+
   // when setting to 0, expect 100% cpu usage
   void set_poll_interval(clock::duration d) { _poll_interval = d; }
 
+  // cycles in a row without a quiet period after which one idle task slice
+  // runs anyway
+  void set_idle_starvation_limit(size_t cycles) {
+    _idle_starvation_limit = std::max<size_t>(cycles, 1);
+  }
+
+  // poll, sleep and report timers and unix signals through the given
+  // backend, e.g. to record or replay, see backend.h. pass nullptr to detach.
+  void set_backend(backend* b) { _backend = b; }
+
+  // publish progress through each cycle phase to the given heartbeat, which
+  // may be watched from another thread. pass nullptr to detach.
+  void set_heartbeat(heartbeat* hb) {
+    _heartbeat = hb;
+    beat(loop_phase::idle);
+  }
+
+  // time packets spent between the kernel receiving them and being read on
+  // the loop, recorded by sockets with rx timestamps enabled, see
+  // rx_timestamp.h
+  const histogram& rx_delay() const { return _rx_delay; }
+  void record_rx_delay(std::chrono::nanoseconds d) {
+    _rx_delay.record(d.count());
+  }
+  void reset_rx_delay() { _rx_delay.reset(); }
+
+  // the time the current cycle woke up, refreshed again before timers run.
+  // cheaper than clock::now() for slots which only need a coarse time, e.g.
+  // log timestamps.
+  clock::time_point cached_now() const { return _cycle_time; }
+
+  // wall clock counterpart of cached_now(), read at most once per cycle and
+  // only when asked for
+  std::chrono::system_clock::time_point cached_wall_time() {
+    if (!_wall_time_valid) {
+      _wall_time = std::chrono::system_clock::now();
+      _wall_time_valid = true;
+    }
+    return _wall_time;
+  }
+
+  // label the currently running registration, e.g. from inside a slot.
+  // only has an effect when a heartbeat is attached.
+  void annotate(const char* label) {
+    if (_heartbeat) [[unlikely]]
+      _heartbeat->annotate(label);
+  }
+
  private:
   struct callback_context {
     uint64_t _id{};
     clock::time_point _fire_at;
     slot<> _cb;
+    // set for post_once callbacks
+    std::optional<uint64_t> _key;
 
     void operator()() { _cb(); }
   };
 
+  struct idle_task {
+    uint64_t _id{};
+    idle_slot _task;
+    clock::duration _budget;
+  };
+
   struct signal_handler {
     closer _closer;
     unix::signal _signal;
   };
 
-  struct pending_poll_addition {
-    int _fd = -1;
-    fd_slots _slots;
-    fd_events _events;
-  };
-
   struct fd_handler {
     int _fd = -1;
     fd_slots _slots;
     fd_events _events;
+    void* _user_data = nullptr;
+    bool _batched = false;
     bool _active = false;
 
     bool want_read() const { return static_cast<int>(_events) & POLLIN; }
     bool want_write() const { return static_cast<int>(_events) & POLLOUT; }
 
+    // revents of interest to this handler
+    short wanted(short revents) const {
+      return revents & (POLLERR | POLLHUP | static_cast<int>(_events));
+    }
+
     void readable(int fd) {
       if (_slots.readable) _slots.readable(fd);
     }
@@ -227,6 +442,10 @@ class loop {
       return;
     }
 
+    trace::span cycle_span("cycle", "hula.loop");
+    HULA_PROBE(cycle_start);
+    _in_cycle = true;
+
     auto now = clock::now();
     bool want_write =
         std::any_of(_fd_handlers.begin(), _fd_handlers.end(),
@@ -238,23 +457,80 @@ class loop {
       if (next_cb_time < sleep_until) sleep_until = next_cb_time;
     }
 
+    if (!_idle_tasks.empty()) {
+      if (sleep_until > now) {
+        now = run_idle_tasks(now, sleep_until, _idle_tasks.size());
+        _idle_starved_cycles = 0;
+      } else if (++_idle_starved_cycles >= _idle_starvation_limit) {
+        now = run_idle_tasks(now, clock::time_point::max(), 1);
+        _idle_starved_cycles = 0;
+      }
+    }
+
     if (sleep_until > now) {
-      std::this_thread::sleep_until(sleep_until);
+      trace::span sleep_span("sleep", "hula.loop");
+      HULA_PROBE1(block_enter, to_ns(sleep_until - now));
+      if (_backend) [[unlikely]] {
+        _backend->sleep(sleep_until - now);
+      } else {
+        std::this_thread::sleep_until(sleep_until);
+      }
       now = clock::now();
+      HULA_PROBE(block_exit);
     }
     _next_poll_time = now + _poll_interval;
-
-    int poll_res = ::poll(_pollfds.data(), _pollfds.size(), 0);
+    set_cycle_time(now);
+
+    int poll_res = 0;
+    {
+      trace::span poll_span("poll", "hula.loop");
+      beat(loop_phase::poll);
+      if (_backend) [[unlikely]] {
+        poll_res = _backend->poll(_pollfds, to_ns(now.time_since_epoch()));
+      } else {
+        poll_res = ::poll(_pollfds.data(), _pollfds.size(), 0);
+      }
+    }
     if (poll_res < 0) {
-      if (errno == EINTR) return;
+      const int err = errno;
+      end_cycle();
+      if (err == EINTR) return;
       throw std::runtime_error("hula::loop => poll failed");
     }
 
     if (poll_res > 0) {
+      trace::span dispatch_span("fd_dispatch", "hula.loop");
       _processing_fds = true;
-      for (size_t i = 0; i < _pollfds.size(); ++i) {
-        auto pfd = _pollfds.at(i);
-        auto& handler = _fd_handlers.at(i);
+      // skip straight to the ready entries, stopping after the last one
+      const auto next_ready = detail::pollfd_scan.next_ready;
+      const size_t n = _pollfds.size();
+      int remaining = poll_res;
+      for (size_t i = next_ready(_pollfds.data(), n, 0);
+           i < n && remaining > 0; i = next_ready(_pollfds.data(), n, i + 1)) {
+        remaining--;
+        const auto pfd = _pollfds[i];
+        auto& handler = _fd_handlers[i];
+        // removed by remove_fds earlier in the cycle
+        if (!_pending_poll_removals.empty() &&
+            _pending_poll_removals.contains(pfd.fd)) {
+          continue;
+        }
+
+        if (handler._batched) {
+          short revents = handler.wanted(pfd.revents);
+          if (handler._active && revents) {
+            _ready_events.emplace_back(ready_event{
+                .fd = pfd.fd,
+                .revents = revents,
+                .user_data = handler._user_data,
+            });
+          }
+          continue;
+        }
+
+        trace::span fd_span("fd", "hula.fd", pfd.fd);
+        beat(loop_phase::fd_dispatch, pfd.fd);
+        HULA_PROBE2(fd_dispatch, pfd.fd, pfd.revents);
 
         if (handler._active && (pfd.revents & (POLLERR | POLLHUP))) {
           handler.error(pfd.fd);
@@ -269,47 +545,202 @@ class loop {
           handler.writable(pfd.fd);
         }
       }
+
+      // per-fd slots may have removed batched fds collected above, whose
+      // user_data may be gone by now. removing an active fd during dispatch
+      // always queues it, so the queue covers inactive handlers too.
+      if (!_ready_events.empty() && !_pending_poll_removals.empty()) {
+        std::erase_if(_ready_events, [&](const ready_event& ev) {
+          return _pending_poll_removals.contains(ev.fd);
+        });
+      }
+      if (!_ready_events.empty()) {
+        trace::span ready_span("ready_batch", "hula.fd",
+                               static_cast<int64_t>(_ready_events.size()));
+        beat(loop_phase::fd_dispatch);
+        if (_ready_slot) _ready_slot(_ready_events);
+        _ready_events.clear();
+      }
       _processing_fds = false;
     }
 
     now = clock::now();
-
-    while (!_callback_contexts.empty() &&
-           _callback_contexts.back()._fire_at <= now && !_stopping) {
-      auto cb = std::move(_callback_contexts.back());
-      _callback_contexts.pop_back();
-      cb();
+    set_cycle_time(now);
+
+    {
+      trace::span timers_span("timers", "hula.loop");
+      while (!_callback_contexts.empty() &&
+             _callback_contexts.back()._fire_at <= now && !_stopping) {
+        auto cb = std::move(_callback_contexts.back());
+        _callback_contexts.pop_back();
+        // the callback may post again with its own key
+        if (cb._key) forget_key(*cb._key, cb._id);
+        if (cancelled(cb._id)) continue;
+        trace::span timer_span("timer", "hula.timer",
+                               static_cast<int64_t>(cb._id));
+        beat(loop_phase::timers, cb._id);
+        HULA_PROBE2(timer_fire, cb._id, to_ns(now - cb._fire_at));
+        if (_backend) [[unlikely]]
+          _backend->on_timer(cb._id, to_ns(now.time_since_epoch()));
+        cb();
+      }
     }
 
-    while (!_queued_unix_signals.empty() && !_stopping) {
-      auto unix_s = _queued_unix_signals.front();
-      _queued_unix_signals.pop_front();
-      auto& sig = get_unix_signal(unix_s);
-      sig();
+    if (!_queued_unix_signals.empty()) {
+      trace::span signals_span("signals", "hula.loop");
+      while (!_queued_unix_signals.empty() && !_stopping) {
+        auto unix_s = _queued_unix_signals.front();
+        _queued_unix_signals.pop_front();
+        auto& sig = get_unix_signal(unix_s);
+        trace::span unix_signal_span("unix_signal", "hula.signal",
+                                     static_cast<int64_t>(unix_s));
+        beat(loop_phase::signals, static_cast<int64_t>(unix_s));
+        if (_backend) [[unlikely]]
+          _backend->on_unix_signal(unix_s, to_ns(now.time_since_epoch()));
+        sig();
+      }
     }
 
+    end_cycle();
+  }
+
+  void end_cycle() {
     handle_fd_changes();
+    handle_cancellations();
+    _in_cycle = false;
+    beat(loop_phase::idle);
+    HULA_PROBE(cycle_end);
+  }
+
+  static int64_t to_ns(clock::duration d) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+  }
+
+  // up to max_slices of a round robin pass over the idle tasks, until the
+  // loop has to poll or is stopped
+  clock::time_point run_idle_tasks(clock::time_point now,
+                                   clock::time_point until,
+                                   size_t max_slices) {
+    const size_t n = std::min(max_slices, _idle_tasks.size());
+    for (size_t i = 0;
+         i < n && now < until && !_idle_tasks.empty() && !_stopping; ++i) {
+      auto task = std::move(_idle_tasks.front());
+      _idle_tasks.pop_front();
+      if (cancelled(task._id)) continue;
+
+      trace::span idle_span("idle_task", "hula.idle",
+                            static_cast<int64_t>(task._id));
+      beat(loop_phase::idle_tasks, task._id);
+      _running_idle = task._id;
+      _running_idle_cancelled = false;
+      auto res = task._task(std::min(now + task._budget, until));
+      if (res == idle_result::more && !_running_idle_cancelled) {
+        _idle_tasks.push_back(std::move(task));
+      }
+      _running_idle = 0;
+      now = clock::now();
+    }
+    beat(loop_phase::idle);
+    return now;
+  }
+
+  void cancel_idle(uint64_t id) {
+    if (id == _running_idle) {
+      _running_idle_cancelled = true;
+      return;
+    }
+    std::erase_if(_idle_tasks,
+                  [=](const idle_task& task) { return task._id == id; });
+  }
+
+  // keeps the vector sorted with the next callback to fire at the end
+  void insert_callback(callback_context ctx) {
+    auto it = _callback_contexts.rbegin();
+    while (it != _callback_contexts.rend() && ctx._fire_at > it->_fire_at) {
+      it++;
+    }
+    _callback_contexts.insert(it.base(), std::move(ctx));
+  }
+
+  typename std::vector<callback_context>::iterator find_callback(uint64_t id) {
+    return std::find_if(
+        _callback_contexts.begin(), _callback_contexts.end(),
+        [=](const callback_context& ctx) { return ctx._id == id; });
+  }
+
+  void beat(loop_phase phase, int64_t id = -1) {
+    if (_heartbeat) [[unlikely]]
+      _heartbeat->beat(phase, id);
   }
 
   void handle_fd_changes() {
-    if (!_pending_poll_removals.empty()) {
-      std::erase_if(_pollfds, [&](const struct pollfd& pfd) {
-        return _pending_poll_removals.contains(pfd.fd);
-      });
-      std::erase_if(_fd_handlers, [&](const fd_handler& fdh) {
-        return _pending_poll_removals.contains(fdh._fd);
-      });
+    sweep_fd_removals();
+    for (fd_handler& fdh : _pending_poll_additions) {
+      push_back_fd(std::move(fdh));
     }
+    _pending_poll_additions.clear();
+  }
+
+  void sweep_fd_removals() {
+    if (_pending_poll_removals.empty()) return;
+    std::erase_if(_pollfds, [&](const struct pollfd& pfd) {
+      return _pending_poll_removals.contains(pfd.fd);
+    });
+    std::erase_if(_fd_handlers, [&](const fd_handler& fdh) {
+      return _pending_poll_removals.contains(fdh._fd);
+    });
     _pending_poll_removals.clear();
-    for (const pending_poll_addition& ppa : _pending_poll_additions) {
-      push_back_fd(ppa._fd, ppa._slots, ppa._events);
+  }
+
+  bool cancelled(uint64_t id) const {
+    return !_pending_cancellations.empty() &&
+           _pending_cancellations.contains(id);
+  }
+
+  void handle_cancellations() {
+    if (_pending_cancellations.empty()) return;
+    std::erase_if(_callback_contexts, [&](const callback_context& ctx) {
+      if (!_pending_cancellations.contains(ctx._id)) return false;
+      if (ctx._key) forget_key(*ctx._key, ctx._id);
+      return true;
+    });
+    std::erase_if(_idle_tasks, [&](const idle_task& task) {
+      return _pending_cancellations.contains(task._id);
+    });
+    _pending_cancellations.clear();
+  }
+
+  // the key may already belong to a callback posted after id
+  void forget_key(uint64_t key, uint64_t id) {
+    auto it = _keyed_callbacks.find(key);
+    if (it != _keyed_callbacks.end() && it->second == id) {
+      _keyed_callbacks.erase(it);
     }
-    _pending_poll_additions.clear();
+  }
+
+  // keeps the ids, ascending as handed out by post, of callbacks and idle
+  // tasks which are still waiting to run
+  void retain_pending(std::vector<uint64_t>& ids) const {
+    std::vector<bool> live(ids.size());
+    auto mark = [&](uint64_t id) {
+      auto it = std::lower_bound(ids.begin(), ids.end(), id);
+      if (it != ids.end() && *it == id && !cancelled(id)) {
+        live[it - ids.begin()] = true;
+      }
+    };
+    for (const auto& ctx : _callback_contexts) mark(ctx._id);
+    for (const auto& task : _idle_tasks) mark(task._id);
+
+    size_t kept = 0;
+    for (size_t i = 0; i < ids.size(); ++i) {
+      if (live[i]) ids[kept++] = ids[i];
+    }
+    ids.resize(kept);
   }
 
   bool work_to_do() const noexcept {
     return !(_pollfds.empty() && _callback_contexts.empty() &&
-             _queued_unix_signals.empty());
+             _queued_unix_signals.empty() && _idle_tasks.empty());
   }
 
   unix::signal& get_unix_signal(unix::sig s) {
@@ -331,33 +762,65 @@ class loop {
     return handler._signal;
   }
 
-  void push_back_fd(int fd, fd_slots slots, fd_events events) {
-    struct pollfd pfd{fd, static_cast<uint8_t>(events), 0};
+  void set_cycle_time(clock::time_point now) {
+    _cycle_time = now;
+    _wall_time_valid = false;
+  }
+
+  void register_fd(fd_handler fdh) {
+    HULA_PROBE2(add_fd, fdh._fd, static_cast<int>(fdh._events));
+    if (_processing_fds) {
+      _pending_poll_additions.emplace_back(std::move(fdh));
+      return;
+    }
+    // the fd number was reused before its removal was swept
+    if (_pending_poll_removals.contains(fdh._fd)) sweep_fd_removals();
+    push_back_fd(std::move(fdh));
+  }
+
+  void push_back_fd(fd_handler fdh) {
+    struct pollfd pfd{fdh._fd, static_cast<uint8_t>(fdh._events), 0};
     _pollfds.push_back(pfd);
-    _fd_handlers.push_back(fd_handler{
-        ._fd = fd,
-        ._slots = slots,
-        ._events = events,
-        ._active = true,
-    });
+    fdh._active = true;
+    _fd_handlers.push_back(std::move(fdh));
   }
 
   bool _stopping = false;
+  heartbeat* _heartbeat = nullptr;
+  backend* _backend = nullptr;
   clock::duration _poll_interval{100us};
   clock::time_point _next_poll_time{};
+  clock::time_point _cycle_time = clock::now();
+  std::chrono::system_clock::time_point _wall_time{};
+  bool _wall_time_valid = false;
 
+  bool _in_cycle = false;
   bool _processing_fds = false;
   std::vector<struct pollfd> _pollfds;
-  std::vector<pending_poll_addition> _pending_poll_additions;
+  std::vector<fd_handler> _pending_poll_additions;
   std::unordered_set<int> _pending_poll_removals;
   std::vector<fd_handler> _fd_handlers;
+  ready_slot _ready_slot;
+  std::vector<ready_event> _ready_events;
   uint64_t _next_callback_id = 1;
   // next callback to fire is at the end of the vector
   std::vector<callback_context> _callback_contexts;
+  // post_once key to the id of its pending callback
+  std::unordered_map<uint64_t, uint64_t> _keyed_callbacks;
+  // cancel_callbacks ids not swept from the tables yet
+  std::unordered_set<uint64_t> _pending_cancellations;
+  std::deque<idle_task> _idle_tasks;
+  uint64_t _running_idle = 0;
+  size_t _idle_starved_cycles = 0;
+  size_t _idle_starvation_limit = 64;
+  bool _running_idle_cancelled = false;
+
+  histogram _rx_delay;
 
   std::unordered_map<unix::sig, signal_handler> _signal_handlers;
   std::deque<unix::sig> _queued_unix_signals;
 
+  friend class closer_group<Clock>;
   friend struct test::loop_test;
   friend struct test::fake_clock_loop_test;
 };
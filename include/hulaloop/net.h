@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+namespace hula::net {
+
+// an ipv4 or ipv6 socket address
+struct address {
+  sockaddr_storage storage{};
+  socklen_t len = 0;
+
+  // parse a numeric ipv4 or ipv6 address
+  static address parse(const std::string& host, uint16_t port) {
+    address a;
+    auto* v4 = reinterpret_cast<sockaddr_in*>(&a.storage);
+    auto* v6 = reinterpret_cast<sockaddr_in6*>(&a.storage);
+    if (::inet_pton(AF_INET, host.c_str(), &v4->sin_addr) == 1) {
+      v4->sin_family = AF_INET;
+      v4->sin_port = htons(port);
+      a.len = sizeof(sockaddr_in);
+    } else if (::inet_pton(AF_INET6, host.c_str(), &v6->sin6_addr) == 1) {
+      v6->sin6_family = AF_INET6;
+      v6->sin6_port = htons(port);
+      a.len = sizeof(sockaddr_in6);
+    } else {
+      throw std::runtime_error("hula::net => invalid address: " + host);
+    }
+    return a;
+  }
+
+  // the address the given socket is bound to
+  static address local(int fd) {
+    address a;
+    a.len = sizeof(a.storage);
+    if (::getsockname(fd, a.get(), &a.len) != 0) a.len = 0;
+    return a;
+  }
+
+  sockaddr* get() { return reinterpret_cast<sockaddr*>(&storage); }
+  const sockaddr* get() const {
+    return reinterpret_cast<const sockaddr*>(&storage);
+  }
+
+  int family() const { return storage.ss_family; }
+
+  uint16_t port() const {
+    if (family() == AF_INET6) {
+      return ntohs(reinterpret_cast<const sockaddr_in6*>(&storage)->sin6_port);
+    }
+    if (family() == AF_INET) {
+      return ntohs(reinterpret_cast<const sockaddr_in*>(&storage)->sin_port);
+    }
+    return 0;
+  }
+};
+
+}  // namespace hula::net
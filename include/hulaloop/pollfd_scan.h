@@ -0,0 +1,81 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+
+#include <sys/poll.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define _HULA_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace hula::detail {
+
+// finds the index of the next pollfd at or after i with non-zero revents,
+// n if there is none
+using next_ready_fn = size_t (*)(const struct pollfd* fds, size_t n, size_t i);
+
+inline size_t next_ready_scalar(const struct pollfd* fds, size_t n, size_t i) {
+  for (; i < n; ++i) {
+    if (fds[i].revents) return i;
+  }
+  return n;
+}
+
+#if defined(_HULA_X86_SIMD)
+
+// each pollfd is 8 bytes with revents in the last 2, so a vector compare of
+// 16 bit lanes against zero yields 2 mask bits per revents at bytes 6 and 7
+// of every pollfd
+static_assert(sizeof(struct pollfd) == 8);
+static_assert(offsetof(struct pollfd, revents) == 6);
+
+__attribute__((target("sse2"))) inline size_t next_ready_sse2(
+    const struct pollfd* fds, size_t n, size_t i) {
+  // dense readiness: the next entry is often ready already
+  if (i < n && fds[i].revents) return i;
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 2 <= n; i += 2) {
+    auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(fds + i));
+    unsigned zeros = _mm_movemask_epi8(_mm_cmpeq_epi16(v, zero));
+    unsigned ready = ~zeros & 0xC0C0u;
+    if (ready) return i + (std::countr_zero(ready) >> 3);
+  }
+  return next_ready_scalar(fds, n, i);
+}
+
+__attribute__((target("avx2"))) inline size_t next_ready_avx2(
+    const struct pollfd* fds, size_t n, size_t i) {
+  if (i < n && fds[i].revents) return i;
+  const __m256i zero = _mm256_setzero_si256();
+  for (; i + 4 <= n; i += 4) {
+    auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(fds + i));
+    unsigned zeros = _mm256_movemask_epi8(_mm256_cmpeq_epi16(v, zero));
+    unsigned ready = ~zeros & 0xC0C0C0C0u;
+    if (ready) return i + (std::countr_zero(ready) >> 3);
+  }
+  return next_ready_scalar(fds, n, i);
+}
+
+#endif
+
+struct pollfd_scanner {
+  next_ready_fn next_ready = next_ready_scalar;
+  const char* name = "scalar";
+};
+
+// picks the widest scan the cpu supports, once at startup
+inline pollfd_scanner select_pollfd_scanner() {
+#if defined(_HULA_X86_SIMD)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return {next_ready_avx2, "avx2"};
+  if (__builtin_cpu_supports("sse2")) return {next_ready_sse2, "sse2"};
+#endif
+  return {};
+}
+
+inline const pollfd_scanner pollfd_scan = select_pollfd_scanner();
+
+}  // namespace hula::detail
@@ -0,0 +1,32 @@
+#pragma once
+
+// usdt (systemtap/dtrace style) static tracepoints, enabled by building with
+// HULA_USDT. probes live in the "hulaloop" provider, e.g.
+//   bpftrace -e 'usdt:./app:hulaloop:timer_fire { @late = hist(arg1); }'
+// when disabled, the probe arguments are never evaluated, only named in
+// sizeof so variables passed to probes don't warn as unused.
+
+#if defined(HULA_USDT)
+
+#include <sys/sdt.h>
+
+#define HULA_PROBE(name) DTRACE_PROBE(hulaloop, name)
+#define HULA_PROBE1(name, a) DTRACE_PROBE1(hulaloop, name, a)
+#define HULA_PROBE2(name, a, b) DTRACE_PROBE2(hulaloop, name, a, b)
+
+#else
+
+#define HULA_PROBE(name) \
+  do {                   \
+  } while (0)
+#define HULA_PROBE1(name, a) \
+  do {                       \
+    (void)sizeof(a);         \
+  } while (0)
+#define HULA_PROBE2(name, a, b) \
+  do {                          \
+    (void)sizeof(a);            \
+    (void)sizeof(b);            \
+  } while (0)
+
+#endif
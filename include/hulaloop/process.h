@@ -0,0 +1,382 @@
+#pragma once
+
+#include "loop.h"
+#include "signal.h"
+#include "sigpipe.h"
+#include "sys.h"
+
+#if !defined(_HULA_LINUX)
+#error "hula::process requires linux (pidfd)"
+#endif
+
+#include <cerrno>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+
+namespace hula {
+
+// how a child's standard stream is set up
+enum class stdio {
+  inherit,  // shared with the parent
+  pipe,     // a pipe to the process object
+  null,     // /dev/null
+};
+
+// how a child ended
+struct process_exit {
+  // the exit code, -1 if killed by a signal or unknown because the child
+  // was reaped elsewhere, e.g. with SIGCHLD ignored
+  int code = -1;
+  // the signal which killed the child, 0 if it exited
+  int signal = 0;
+};
+
+// a child process driven by the loop. the child is spawned with posix_spawn
+// and its exit is noticed through a pidfd registered with the loop, so no
+// SIGCHLD handler or reaper thread is involved. piped output is read as it
+// arrives into a buffer and delivered in chunks; input is written without
+// blocking, queueing whatever the pipe can't take yet.
+template <class Clock = std::chrono::steady_clock>
+class process {
+ public:
+  using clock = Clock;
+  using output_slot =
+      slot<std::span<const std::byte>, struct process_output_slot_tag>;
+  using exit_slot = slot<const process_exit&, struct process_exit_slot_tag>;
+
+  struct slots {
+    // chunks of piped stdout and stderr, valid only for the call
+    output_slot out;
+    output_slot err;
+    // called on the cycle after the child exited, once the output it wrote
+    // has been delivered
+    exit_slot exit;
+  };
+
+  struct options {
+    stdio in = stdio::pipe;
+    stdio out = stdio::pipe;
+    stdio err = stdio::pipe;
+    // resolve the program through PATH
+    bool search_path = true;
+    // the child's environment, the parent's if unset
+    std::optional<std::vector<std::string>> env;
+    // bytes read per read call
+    size_t read_size = 64 * 1024;
+    // reads per readable callback before yielding to other fds
+    size_t max_reads_per_cycle = 4;
+  };
+
+  explicit process(loop<clock>& l, slots s) : process(l, s, options{}) {}
+
+  explicit process(loop<clock>& l, slots s, options opts)
+      : _loop(l), _slots(s), _options(opts) {
+    _buffer.resize(_options.read_size);
+  }
+
+  // a child still running is killed and reaped
+  ~process() {
+    close();
+    if (_pid > 0 && !_exited) {
+      ::kill(_pid, SIGKILL);
+      int status = 0;
+      while (::waitpid(_pid, &status, 0) < 0 && errno == EINTR) {
+      }
+    }
+    if (_pidfd >= 0) ::close(_pidfd);
+  }
+
+  process(const process&) = delete;
+  process& operator=(const process&) = delete;
+
+  // start the child, argv[0] being the program. throws if it can't be run.
+  void spawn(const std::vector<std::string>& argv) {
+    if (_pid > 0) throw std::logic_error("hula::process => already spawned");
+    if (argv.empty()) throw std::invalid_argument("hula::process => no argv");
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    int child_ends[3] = {-1, -1, -1};
+    stdio modes[3] = {_options.in, _options.out, _options.err};
+    int err = 0;
+    for (int i = 0; i < 3 && !err; ++i) {
+      err = setup_stdio(actions, i, modes[i], child_ends[i]);
+    }
+
+    std::vector<char*> args = c_strings(argv);
+    std::vector<char*> env;
+    if (_options.env) env = c_strings(*_options.env);
+
+    pid_t pid = -1;
+    if (!err) {
+      auto spawn = _options.search_path ? ::posix_spawnp : ::posix_spawn;
+      err = spawn(&pid, args[0], &actions, nullptr, args.data(),
+                  _options.env ? env.data() : environ);
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    for (int fd : child_ends) {
+      if (fd >= 0) ::close(fd);
+    }
+    if (err) {
+      close_streams();
+      fail("spawn " + argv[0], err);
+    }
+    _pid = pid;
+
+    _pidfd = static_cast<int>(::syscall(SYS_pidfd_open, _pid, 0));
+    // ESRCH: the child already exited and was reaped elsewhere
+    const bool reaped = _pidfd < 0 && errno == ESRCH;
+    if (_pidfd < 0 && !reaped) {
+      int e = errno;
+      ::kill(_pid, SIGKILL);
+      ::waitpid(_pid, nullptr, 0);
+      _exited = true;
+      close_streams();
+      fail("pidfd_open", e);
+    }
+    if (!reaped) {
+      _pidfd_closer = _loop.add_fd(
+          _pidfd, fd_slots{.readable = [this](int) { on_exit(); }},
+          fd_events::read);
+    }
+
+    register_output(_out, _slots.out);
+    register_output(_err, _slots.err);
+    if (_in._fd >= 0) {
+      _in._closer = _loop.add_fd(
+          _in._fd,
+          fd_slots{
+              .writable = [this](int) { flush_stdin(); },
+              .error = [this](int) { close_stream(_in); },
+          },
+          fd_events::none);
+    }
+    if (reaped) {
+      _exited = true;
+      report_exit();
+    }
+  }
+
+  // queue bytes for the child's stdin. false if stdin isn't piped or was
+  // closed.
+  bool write(std::span<const std::byte> data) {
+    if (_in._fd < 0 || _stdin_closing) return false;
+    _stdin.insert(_stdin.end(), data.begin(), data.end());
+    flush_stdin();
+    return true;
+  }
+
+  // close stdin once everything queued was written, e.g. to signal eof
+  void close_stdin() {
+    _stdin_closing = true;
+    flush_stdin();
+  }
+
+  // send a signal through the pidfd, which can't hit a recycled pid
+  bool kill(int sig = SIGTERM) {
+    if (_pidfd < 0 || _exited) return false;
+    return ::syscall(SYS_pidfd_send_signal, _pidfd, sig, nullptr, 0) == 0;
+  }
+
+  // stop delivering output and the exit; the child keeps running
+  void close() {
+    close_streams();
+    _pidfd_closer.close();
+    _exit_closer.close();
+  }
+
+  pid_t pid() const { return _pid; }
+  bool running() const { return _pid > 0 && !_exited; }
+  std::optional<process_exit> exit_status() const {
+    return _exited && _pid > 0 ? std::optional(_status) : std::nullopt;
+  }
+
+ private:
+  struct stream {
+    int _fd = -1;
+    closer _closer;
+  };
+
+  [[noreturn]] void fail(const std::string& what, int err) {
+    throw std::runtime_error("hula::process => " + what +
+                             " failed: " + std::strerror(err));
+  }
+
+  static std::vector<char*> c_strings(const std::vector<std::string>& s) {
+    std::vector<char*> out;
+    out.reserve(s.size() + 1);
+    for (const auto& str : s) out.push_back(const_cast<char*>(str.c_str()));
+    out.push_back(nullptr);
+    return out;
+  }
+
+  stream& stream_of(int child_fd) {
+    return child_fd == 0 ? _in : child_fd == 1 ? _out : _err;
+  }
+
+  // arranges the child's fd, keeping the parent's end of a pipe
+  int setup_stdio(posix_spawn_file_actions_t& actions, int child_fd,
+                  stdio mode, int& child_end) {
+    if (mode == stdio::inherit) return 0;
+    if (mode == stdio::null) {
+      return posix_spawn_file_actions_addopen(
+          &actions, child_fd, "/dev/null", child_fd == 0 ? O_RDONLY : O_WRONLY,
+          0);
+    }
+
+    int p[2];
+    if (::pipe2(p, O_CLOEXEC) != 0) return errno;
+    // the child's end stays blocking, dup2 clears its close on exec flag
+    int parent_end = child_fd == 0 ? p[1] : p[0];
+    child_end = child_fd == 0 ? p[0] : p[1];
+    ::fcntl(parent_end, F_SETFL, ::fcntl(parent_end, F_GETFL) | O_NONBLOCK);
+    stream_of(child_fd)._fd = parent_end;
+    return posix_spawn_file_actions_adddup2(&actions, child_end, child_fd);
+  }
+
+  void register_output(stream& s, const output_slot& slot) {
+    if (s._fd < 0) return;
+    s._closer = _loop.add_fd(
+        s._fd,
+        fd_slots{
+            .readable = [this, &s, &slot](int) { read_output(s, slot); },
+            .error = [this, &s, &slot](int) { read_output(s, slot); },
+        },
+        fd_events::read);
+  }
+
+  // reads up to max_reads_per_cycle chunks, or until drained
+  void read_output(stream& s, const output_slot& slot, bool drain = false) {
+    const size_t max_reads = drain ? SIZE_MAX : _options.max_reads_per_cycle;
+    for (size_t i = 0; s._fd >= 0 && i < max_reads; ++i) {
+      auto n = ::read(s._fd, _buffer.data(), _buffer.size());
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) close_stream(s);
+        return;
+      }
+      if (n == 0) {
+        close_stream(s);
+        return;
+      }
+      if (slot) slot(std::span<const std::byte>(_buffer.data(), n));
+    }
+  }
+
+  void flush_stdin() {
+    if (_in._fd < 0) return;
+    while (_stdin_offset < _stdin.size()) {
+      // a child which closed its stdin fails the write with EPIPE
+      auto n = without_sigpipe([&] {
+        return ::write(_in._fd, _stdin.data() + _stdin_offset,
+                       _stdin.size() - _stdin_offset);
+      });
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+        // the child closed its stdin
+        close_stream(_in);
+        return;
+      }
+      _stdin_offset += n;
+    }
+
+    if (_stdin_offset == _stdin.size()) {
+      _stdin.clear();
+      _stdin_offset = 0;
+      if (_stdin_closing) {
+        close_stream(_in);
+        return;
+      }
+    }
+    _loop.update_fd(_in._fd, _stdin.empty() ? fd_events::none
+                                            : fd_events::write);
+  }
+
+  void close_stream(stream& s) {
+    s._closer.close();
+    if (s._fd >= 0) ::close(s._fd);
+    s._fd = -1;
+    if (&s == &_in) {
+      _stdin.clear();
+      _stdin_offset = 0;
+    }
+  }
+
+  void close_streams() {
+    close_stream(_in);
+    close_stream(_out);
+    close_stream(_err);
+  }
+
+  void on_exit() {
+    siginfo_t info{};
+    int res;
+    do {
+      res = ::waitid(P_PID, _pid, &info, WEXITED | WNOHANG);
+    } while (res != 0 && errno == EINTR);
+    if (res == 0 && info.si_pid == 0) return;
+    _exited = true;
+    _pidfd_closer.close();
+    if (res != 0) {
+      // already reaped, by SIGCHLD being ignored or by another waiter. the
+      // pidfd stays readable, so the exit is reported without a status.
+      _status = process_exit{};
+    } else if (info.si_code == CLD_EXITED) {
+      _status = process_exit{.code = info.si_status, .signal = 0};
+    } else {
+      _status = process_exit{.code = -1, .signal = info.si_status};
+    }
+    report_exit();
+  }
+
+  void report_exit() {
+    // whatever the child wrote before exiting is in the pipes by now
+    read_output(_out, _slots.out, true);
+    read_output(_err, _slots.err, true);
+
+    // deferred so the slot may safely destroy the process
+    _exit_closer = _loop.schedule([this] {
+      _exit_closer = closer();
+      auto on_exit = _slots.exit;
+      auto status = _status;
+      if (on_exit) on_exit(status);
+    });
+  }
+
+  loop<clock>& _loop;
+  slots _slots;
+  options _options;
+
+  pid_t _pid = -1;
+  int _pidfd = -1;
+  bool _exited = false;
+  process_exit _status;
+  closer _pidfd_closer;
+  closer _exit_closer;
+
+  stream _in;
+  stream _out;
+  stream _err;
+  std::vector<std::byte> _buffer;
+  std::vector<std::byte> _stdin;
+  size_t _stdin_offset = 0;
+  bool _stdin_closing = false;
+};
+
+}  // namespace hula
@@ -0,0 +1,299 @@
+#pragma once
+
+#include "backend.h"
+#include "loop.h"
+#include "unix_sig.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/poll.h>
+
+namespace hula {
+
+// recordings are a magic header followed by records of:
+//   u8 type, varint ns since the previous record, payload
+// where the payload is
+//   poll:   varint count, count * (varint fd, varint revents)
+//   timer:  varint callback id
+//   signal: varint signal number
+namespace replay {
+
+static constexpr char k_magic[8] = {'H', 'U', 'L', 'A', 'R', 'E', 'C', '1'};
+
+enum class record_type : uint8_t { poll = 1, timer = 2, signal = 3 };
+
+struct ready_fd {
+  int fd = -1;
+  short revents = 0;
+};
+
+struct record {
+  record_type type = record_type::poll;
+  std::chrono::nanoseconds at{};  // since the first record
+  std::vector<ready_fd> fds;      // poll only
+  uint64_t value = 0;             // timer id or signal number
+};
+
+inline void write_varint(std::ostream& os, uint64_t v) {
+  while (v >= 0x80) {
+    os.put(static_cast<char>((v & 0x7f) | 0x80));
+    v >>= 7;
+  }
+  os.put(static_cast<char>(v));
+}
+
+inline uint64_t read_varint(std::istream& is) {
+  uint64_t v = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int c = is.get();
+    if (c == std::char_traits<char>::eof()) {
+      throw std::runtime_error("hula::replay => truncated recording");
+    }
+    v |= static_cast<uint64_t>(c & 0x7f) << shift;
+    if (!(c & 0x80)) return v;
+  }
+  throw std::runtime_error("hula::replay => malformed varint");
+}
+
+// reads a whole recording into memory
+inline std::vector<record> read(std::istream& is) {
+  char magic[sizeof(k_magic)];
+  if (!is.read(magic, sizeof(magic)) ||
+      std::memcmp(magic, k_magic, sizeof(k_magic)) != 0) {
+    throw std::runtime_error("hula::replay => not a recording");
+  }
+
+  std::vector<record> records;
+  std::chrono::nanoseconds at{};
+  for (int c = is.get(); c != std::char_traits<char>::eof(); c = is.get()) {
+    record r{.type = static_cast<record_type>(c)};
+    at += std::chrono::nanoseconds(read_varint(is));
+    r.at = at;
+
+    switch (r.type) {
+      case record_type::poll: {
+        auto n = read_varint(is);
+        r.fds.reserve(n);
+        for (uint64_t i = 0; i < n; ++i) {
+          auto fd = static_cast<int>(read_varint(is));
+          auto revents = static_cast<short>(read_varint(is));
+          r.fds.emplace_back(ready_fd{.fd = fd, .revents = revents});
+        }
+        break;
+      }
+      case record_type::timer:
+      case record_type::signal:
+        r.value = read_varint(is);
+        break;
+      default:
+        throw std::runtime_error("hula::replay => unknown record type");
+    }
+    records.emplace_back(std::move(r));
+  }
+  return records;
+}
+
+}  // namespace replay
+
+// backend which polls for real and records everything the loop sees: ready
+// descriptors, timer firings and unix signal deliveries. attach it to any
+// loop with set_backend. the output stream must outlive the recording.
+class recording_backend : public backend {
+ public:
+  void record_to(std::ostream& os) {
+    _os = &os;
+    _os->write(replay::k_magic, sizeof(replay::k_magic));
+    _started = false;
+  }
+
+  int poll(std::span<struct pollfd> fds, int64_t now_ns) override {
+    int res = backend::poll(fds, now_ns);
+    if (res <= 0 || !_os) return res;
+
+    begin_record(replay::record_type::poll, now_ns);
+    replay::write_varint(*_os, res);
+    for (const auto& pfd : fds) {
+      if (!pfd.revents) continue;
+      replay::write_varint(*_os, pfd.fd);
+      replay::write_varint(*_os, static_cast<uint16_t>(pfd.revents));
+    }
+    return res;
+  }
+
+  void on_timer(uint64_t id, int64_t now_ns) override {
+    if (!_os) return;
+    begin_record(replay::record_type::timer, now_ns);
+    replay::write_varint(*_os, id);
+  }
+
+  void on_unix_signal(unix::sig s, int64_t now_ns) override {
+    if (!_os) return;
+    begin_record(replay::record_type::signal, now_ns);
+    replay::write_varint(*_os, static_cast<uint64_t>(s));
+  }
+
+ private:
+  void begin_record(replay::record_type type, int64_t now_ns) {
+    if (!_started) {
+      _last_ns = now_ns;
+      _started = true;
+    }
+    _os->put(static_cast<char>(type));
+    replay::write_varint(*_os, static_cast<uint64_t>(now_ns - _last_ns));
+    _last_ns = now_ns;
+  }
+
+  std::ostream* _os = nullptr;
+  bool _started = false;
+  int64_t _last_ns = 0;
+};
+
+// backend which never touches the kernel, instead reporting whatever
+// readiness the replayer has armed for the current cycle. it never sleeps,
+// the replayer moves the clock, and checks timers fire in recorded order.
+class replay_backend : public backend {
+ public:
+  void arm(std::span<const replay::ready_fd> fds) {
+    _armed.assign(fds.begin(), fds.end());
+  }
+
+  // the timer ids of the recording, in firing order
+  void expect_timers(std::vector<uint64_t> ids) {
+    _expected = std::move(ids);
+    _next_expected = 0;
+    _timers_fired = 0;
+    _divergence.clear();
+  }
+
+  int poll(std::span<struct pollfd> fds, int64_t) override {
+    int res = 0;
+    for (auto& pfd : fds) {
+      pfd.revents = 0;
+      for (const auto& r : _armed) {
+        if (r.fd != pfd.fd) continue;
+        pfd.revents = r.revents;
+        res++;
+        break;
+      }
+    }
+    _armed.clear();
+    return res;
+  }
+
+  void sleep(std::chrono::nanoseconds) override {}
+
+  void on_timer(uint64_t id, int64_t) override {
+    _timers_fired++;
+    if (!_divergence.empty()) return;
+    if (_next_expected == _expected.size()) {
+      _divergence = "timer " + std::to_string(id) + " was not recorded";
+    } else if (_expected[_next_expected] != id) {
+      _divergence = "timer " + std::to_string(id) + " fired, recording has " +
+                    std::to_string(_expected[_next_expected]);
+    } else {
+      _next_expected++;
+    }
+  }
+
+  // number of timer callbacks fired during replay
+  uint64_t timers_fired() const { return _timers_fired; }
+
+  // why the replay stopped matching the recording, empty if it matches.
+  // recorded timers which never fired count once the replay is over.
+  std::string divergence() const {
+    if (_divergence.empty() && _next_expected < _expected.size()) {
+      return "recorded timer " + std::to_string(_expected[_next_expected]) +
+             " never fired";
+    }
+    return _divergence;
+  }
+
+ private:
+  std::vector<replay::ready_fd> _armed;
+  std::vector<uint64_t> _expected;
+  size_t _next_expected = 0;
+  uint64_t _timers_fired = 0;
+  std::string _divergence;
+};
+
+// feeds a recording into a loop running on a manually advanced clock, which
+// must provide now() and advance(duration) (e.g. a fake clock), so replaying
+// never waits for real time to pass.
+// the application is expected to register the same fds, timers and signals as
+// when recording. the recording's first event happens at the clock's current
+// time.
+template <class Clock>
+class replayer {
+ public:
+  explicit replayer(std::istream& is) : _records(replay::read(is)) {}
+
+  explicit replayer(std::vector<replay::record> records)
+      : _records(std::move(records)) {}
+
+  const std::vector<replay::record>& records() const { return _records; }
+
+  // replays every record, running one loop cycle per recorded poll or
+  // distinct timestamp. throws if timers didn't fire as recorded.
+  // returns the number of cycles run.
+  size_t run(loop<Clock>& l) {
+    std::vector<uint64_t> timers;
+    for (const auto& r : _records) {
+      if (r.type == replay::record_type::timer) timers.push_back(r.value);
+    }
+    _backend.expect_timers(std::move(timers));
+
+    l.set_backend(&_backend);
+    struct detach {
+      loop<Clock>& _l;
+      ~detach() { _l.set_backend(nullptr); }
+    } detach{l};
+
+    const auto start = Clock::now();
+    size_t cycles = 0;
+
+    for (size_t i = 0; i < _records.size();) {
+      const auto at = _records[i].at;
+      auto target = start + std::chrono::duration_cast<
+                                typename Clock::duration>(at);
+      if (Clock::now() < target) Clock::advance(target - Clock::now());
+
+      // each poll record starts a new cycle
+      bool polled = false;
+      for (; i < _records.size() && _records[i].at == at; ++i) {
+        const auto& r = _records[i];
+        if (r.type == replay::record_type::poll) {
+          if (polled) break;
+          _backend.arm(r.fds);
+          polled = true;
+        } else if (r.type == replay::record_type::signal) {
+          l.queue_unix_signal(static_cast<unix::sig>(r.value));
+        }
+      }
+
+      l.run_once();
+      cycles++;
+    }
+
+    if (auto why = _backend.divergence(); !why.empty()) {
+      throw std::runtime_error("hula::replay => replay diverged: " + why);
+    }
+    return cycles;
+  }
+
+  // number of timer callbacks fired by the last run
+  uint64_t timers_fired() const { return _backend.timers_fired(); }
+
+ private:
+  std::vector<replay::record> _records;
+  replay_backend _backend;
+};
+
+}  // namespace hula
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "sys.h"
+
+#if !defined(_HULA_LINUX)
+#error "hula rx timestamps require linux (SO_TIMESTAMPNS)"
+#endif
+
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <optional>
+#include <span>
+
+#include <sys/socket.h>
+#include <time.h>
+
+namespace hula::net {
+
+// when the kernel received a packet, on the realtime clock
+using kernel_time = std::chrono::system_clock::time_point;
+
+// ask the kernel to software timestamp packets received on the socket
+inline bool enable_rx_timestamps(int fd) {
+  int one = 1;
+  return ::setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one)) == 0;
+}
+
+// control buffer space needed for a timestamp
+inline constexpr size_t k_timestamp_control_size =
+    CMSG_SPACE(sizeof(struct timespec));
+
+// the receive timestamp attached to a message by recvmsg, if any
+inline std::optional<kernel_time> rx_timestamp(const msghdr& hdr) {
+  for (cmsghdr* cm = CMSG_FIRSTHDR(&hdr); cm;
+       cm = CMSG_NXTHDR(const_cast<msghdr*>(&hdr), cm)) {
+    if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_TIMESTAMPNS) {
+      continue;
+    }
+    struct timespec ts{};
+    std::memcpy(&ts, CMSG_DATA(cm), sizeof(ts));
+    auto since_epoch =
+        std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+    return kernel_time(
+        std::chrono::duration_cast<kernel_time::duration>(since_epoch));
+  }
+  return std::nullopt;
+}
+
+// time from the kernel receiving a packet until now
+inline std::chrono::nanoseconds rx_delay(kernel_time t) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::system_clock::now() - t);
+}
+
+struct timestamped_read {
+  // as returned by recvmsg
+  ssize_t bytes = 0;
+  // when the kernel received the first byte read, if timestamps are enabled
+  std::optional<kernel_time> time;
+};
+
+// read from a socket with rx timestamps enabled, e.g. in a readable slot
+inline timestamped_read recv_timestamped(int fd, std::span<std::byte> buf,
+                                         int flags = MSG_DONTWAIT) {
+  alignas(cmsghdr) std::byte control[k_timestamp_control_size];
+  iovec iov{buf.data(), buf.size()};
+  msghdr hdr{};
+  hdr.msg_iov = &iov;
+  hdr.msg_iovlen = 1;
+  hdr.msg_control = control;
+  hdr.msg_controllen = sizeof(control);
+
+  timestamped_read res;
+  res.bytes = ::recvmsg(fd, &hdr, flags);
+  if (res.bytes > 0) res.time = rx_timestamp(hdr);
+  return res;
+}
+
+}  // namespace hula::net
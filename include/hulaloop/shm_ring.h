@@ -0,0 +1,401 @@
+#pragma once
+
+#include "loop.h"
+#include "signal.h"
+#include "sys.h"
+
+#if !defined(_HULA_LINUX)
+#error "hula::shm_ring requires linux (memfd_create/eventfd)"
+#endif
+
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace hula {
+
+// single producer single consumer ring of messages in shared memory, for
+// processes on the same host. the ring lives in a memfd which, together with
+// an eventfd used for wakeups, is created by one side and handed to the other
+// over a unix socket (see send_fds/recv_fds). the producer only writes the
+// eventfd when the ring goes from empty to non-empty, and not at all while the
+// consumer busy polls.
+class shm_ring {
+ public:
+  // capacity is rounded up to a power of two of at least a page
+  static shm_ring create(size_t capacity) {
+    capacity = std::bit_ceil(std::max(capacity, k_min_capacity));
+    int memfd = ::memfd_create("hula_shm_ring", MFD_CLOEXEC);
+    if (memfd < 0) fail("memfd_create");
+    if (::ftruncate(memfd, k_data_offset + capacity) != 0) {
+      ::close(memfd);
+      fail("ftruncate");
+    }
+    int efd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (efd < 0) {
+      ::close(memfd);
+      fail("eventfd");
+    }
+
+    shm_ring ring(memfd, efd);
+    new (ring._header) header{};
+    ring._header->capacity = capacity;
+    ring._mask = capacity - 1;
+    return ring;
+  }
+
+  // map a ring created elsewhere, taking ownership of both fds. the header
+  // comes from another process, so its capacity is checked against the size
+  // of the memfd before it is trusted.
+  static shm_ring attach(int memfd, int eventfd) {
+    shm_ring ring(memfd, eventfd);
+    const uint64_t capacity = ring._header->capacity;
+    if (capacity < k_min_capacity || !std::has_single_bit(capacity) ||
+        capacity > ring._size - k_data_offset) {
+      throw std::runtime_error("hula::shm_ring => invalid ring capacity");
+    }
+    ring._mask = capacity - 1;
+    return ring;
+  }
+
+  shm_ring(shm_ring&& o) noexcept { *this = std::move(o); }
+
+  shm_ring& operator=(shm_ring&& o) noexcept {
+    release();
+    _memfd = std::exchange(o._memfd, -1);
+    _eventfd = std::exchange(o._eventfd, -1);
+    _size = std::exchange(o._size, 0);
+    _header = std::exchange(o._header, nullptr);
+    _data = std::exchange(o._data, nullptr);
+    _mask = o._mask;
+    return *this;
+  }
+
+  ~shm_ring() { release(); }
+
+  int memfd() const { return _memfd; }
+  int eventfd() const { return _eventfd; }
+  size_t capacity() const { return _mask + 1; }
+
+  // largest message which always fits an empty ring
+  size_t max_message_size() const { return capacity() / 2 - k_record_header; }
+
+  // producer side. copies the message into the ring, false if it is full.
+  bool try_write(std::span<const std::byte> msg) {
+    if (msg.size() > max_message_size()) {
+      throw std::invalid_argument("hula::shm_ring => message too large");
+    }
+
+    const uint64_t start = _header->head.load(std::memory_order_relaxed);
+    const uint64_t tail = _header->tail.load(std::memory_order_acquire);
+    const size_t need = record_size(msg.size());
+
+    uint64_t pos = start;
+    size_t contiguous = capacity() - (pos & _mask);
+    // records are never split, the rest of the buffer is skipped instead
+    size_t total = need > contiguous ? contiguous + need : need;
+    if (pos - tail + total > capacity()) return false;
+
+    if (need > contiguous) {
+      store_length(pos, k_wrap);
+      pos += contiguous;
+    }
+    store_length(pos, static_cast<uint32_t>(msg.size()));
+    std::memcpy(_data + (pos & _mask) + k_record_header, msg.data(),
+                msg.size());
+
+    // seq_cst orders the head store before the tail load, pairing with the
+    // consumer's tail store and head load, so a consumer about to wait is
+    // always either seen or sees the message
+    _header->head.store(pos + need, std::memory_order_seq_cst);
+    if (!_header->busy_poll.load(std::memory_order_relaxed) &&
+        _header->tail.load(std::memory_order_seq_cst) == start) {
+      uint64_t one = 1;
+      [[maybe_unused]] auto res = ::write(_eventfd, &one, sizeof(one));
+    }
+    return true;
+  }
+
+  // consumer side. calls f with each message, in place in shared memory and
+  // valid only during the call, up to max messages. returns the number read.
+  // throws if a record doesn't fit the ring or what was published.
+  template <class F>
+  size_t read(F&& f, size_t max = SIZE_MAX) {
+    uint64_t tail = _header->tail.load(std::memory_order_relaxed);
+    uint64_t head = _header->head.load(std::memory_order_seq_cst);
+    size_t n = 0;
+    while (n < max) {
+      if (tail == head) {
+        head = _header->head.load(std::memory_order_seq_cst);
+        if (tail == head) break;
+      }
+
+      uint32_t len = load_length(tail);
+      const size_t contiguous = capacity() - (tail & _mask);
+      if (len == k_wrap) {
+        if (contiguous >= head - tail) corrupt();
+        tail += contiguous;
+        _header->tail.store(tail, std::memory_order_seq_cst);
+        continue;
+      }
+      if (len > max_message_size() || record_size(len) > contiguous ||
+          record_size(len) > head - tail) {
+        corrupt();
+      }
+
+      f(std::span<const std::byte>(_data + (tail & _mask) + k_record_header,
+                                   len));
+      tail += record_size(len);
+      // frees the space for the producer
+      _header->tail.store(tail, std::memory_order_seq_cst);
+      n++;
+    }
+    return n;
+  }
+
+  bool empty() const {
+    return _header->head.load(std::memory_order_acquire) ==
+           _header->tail.load(std::memory_order_acquire);
+  }
+
+  // tell the producer not to signal the eventfd, the consumer polls
+  void set_busy_poll(bool busy) {
+    _header->busy_poll.store(busy, std::memory_order_seq_cst);
+  }
+
+  // consume a pending wakeup
+  void clear_notification() {
+    uint64_t count;
+    [[maybe_unused]] auto res = ::read(_eventfd, &count, sizeof(count));
+  }
+
+ private:
+  struct header {
+    // producer owned
+    alignas(64) std::atomic<uint64_t> head{0};
+    // consumer owned
+    alignas(64) std::atomic<uint64_t> tail{0};
+    alignas(64) std::atomic<bool> busy_poll{false};
+    uint64_t capacity = 0;
+  };
+
+  static constexpr size_t k_data_offset = (sizeof(header) + 63) / 64 * 64;
+  static constexpr size_t k_min_capacity = 4096;
+  static constexpr size_t k_record_header = sizeof(uint32_t);
+  static constexpr size_t k_record_align = 8;
+  static constexpr uint32_t k_wrap = UINT32_MAX;
+
+  static_assert(std::atomic<uint64_t>::is_always_lock_free);
+
+  shm_ring(int memfd, int eventfd) : _memfd(memfd), _eventfd(eventfd) {
+    struct stat st{};
+    if (::fstat(memfd, &st) != 0 ||
+        static_cast<size_t>(st.st_size) <= k_data_offset) {
+      release();
+      throw std::runtime_error("hula::shm_ring => invalid ring fd");
+    }
+    _size = st.st_size;
+    void* p =
+        ::mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (p == MAP_FAILED) {
+      release();
+      fail("mmap");
+    }
+    _header = static_cast<header*>(p);
+    _data = static_cast<std::byte*>(p) + k_data_offset;
+  }
+
+  static size_t record_size(size_t len) {
+    return (k_record_header + len + k_record_align - 1) / k_record_align *
+           k_record_align;
+  }
+
+  void store_length(uint64_t pos, uint32_t len) {
+    std::memcpy(_data + (pos & _mask), &len, sizeof(len));
+  }
+
+  uint32_t load_length(uint64_t pos) const {
+    uint32_t len;
+    std::memcpy(&len, _data + (pos & _mask), sizeof(len));
+    return len;
+  }
+
+  void release() {
+    if (_header) ::munmap(_header, _size);
+    if (_memfd >= 0) ::close(_memfd);
+    if (_eventfd >= 0) ::close(_eventfd);
+    _header = nullptr;
+    _data = nullptr;
+    _memfd = _eventfd = -1;
+  }
+
+  [[noreturn]] static void corrupt() {
+    throw std::runtime_error("hula::shm_ring => corrupt record");
+  }
+
+  [[noreturn]] static void fail(const char* what) {
+    throw std::runtime_error(std::string("hula::shm_ring => ") + what +
+                             " failed: " + std::strerror(errno));
+  }
+
+  int _memfd = -1;
+  int _eventfd = -1;
+  size_t _size = 0;
+  header* _header = nullptr;
+  std::byte* _data = nullptr;
+  uint64_t _mask = 0;
+};
+
+// reads messages from a shm_ring on the loop, woken through the ring's
+// eventfd, or in busy poll mode by checking the ring every cycle.
+template <class Clock = std::chrono::steady_clock>
+class shm_ring_consumer {
+ public:
+  using clock = Clock;
+  using message_slot =
+      slot<std::span<const std::byte>, struct shm_message_slot_tag>;
+
+  struct options {
+    // skip notifications and check the ring every cycle, which keeps the loop
+    // from ever sleeping
+    bool busy_poll = false;
+    // messages read per wakeup before yielding to other work
+    size_t max_messages_per_cycle = 1024;
+  };
+
+  explicit shm_ring_consumer(loop<clock>& l, shm_ring& ring, message_slot slot)
+      : shm_ring_consumer(l, ring, slot, options{}) {}
+
+  explicit shm_ring_consumer(loop<clock>& l, shm_ring& ring, message_slot slot,
+                             options opts)
+      : _loop(l), _ring(ring), _slot(slot), _options(opts) {
+    _ring.set_busy_poll(_options.busy_poll);
+    if (_options.busy_poll) {
+      poll();
+      return;
+    }
+    _closer = _loop.add_fd(
+        _ring.eventfd(), fd_slots{.readable = [this](int) { on_notified(); }},
+        fd_events::read);
+    // messages written before we were registered
+    if (!_ring.empty()) _drain_closer = _loop.schedule([this] { drain(); });
+  }
+
+  ~shm_ring_consumer() { _ring.set_busy_poll(false); }
+
+  shm_ring_consumer(const shm_ring_consumer&) = delete;
+  shm_ring_consumer& operator=(const shm_ring_consumer&) = delete;
+
+  uint64_t received() const { return _received; }
+
+ private:
+  void on_notified() {
+    _ring.clear_notification();
+    drain();
+  }
+
+  void drain() {
+    _drain_closer = closer();
+    auto n = _ring.read([this](std::span<const std::byte> msg) { _slot(msg); },
+                        _options.max_messages_per_cycle);
+    _received += n;
+    // more left, continue next cycle without waiting for a notification
+    if (n == _options.max_messages_per_cycle && !_ring.empty()) {
+      _drain_closer = _loop.schedule([this] { drain(); });
+    }
+  }
+
+  void poll() {
+    _drain_closer = _loop.schedule([this] {
+      poll();
+      _received += _ring.read(
+          [this](std::span<const std::byte> msg) { _slot(msg); },
+          _options.max_messages_per_cycle);
+    });
+  }
+
+  loop<clock>& _loop;
+  shm_ring& _ring;
+  message_slot _slot;
+  options _options;
+  closer _closer;
+  closer _drain_closer;
+  uint64_t _received = 0;
+};
+
+// send fds over a unix socket (SCM_RIGHTS), along with a one byte message
+inline bool send_fds(int sock, std::span<const int> fds) {
+  char byte = 0;
+  iovec iov{&byte, 1};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * 16)];
+  if (fds.size() > 16) return false;
+
+  msghdr hdr{};
+  hdr.msg_iov = &iov;
+  hdr.msg_iovlen = 1;
+  hdr.msg_control = control;
+  hdr.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+  cmsghdr* cm = CMSG_FIRSTHDR(&hdr);
+  cm->cmsg_level = SOL_SOCKET;
+  cm->cmsg_type = SCM_RIGHTS;
+  cm->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+  std::memcpy(CMSG_DATA(cm), fds.data(), sizeof(int) * fds.size());
+
+  ssize_t res;
+  do {
+    res = ::sendmsg(sock, &hdr, MSG_NOSIGNAL);
+  } while (res < 0 && errno == EINTR);
+  return res == 1;
+}
+
+// receive fds sent with send_fds, returning how many were stored in fds.
+// received fds are close-on-exec.
+inline size_t recv_fds(int sock, std::span<int> fds) {
+  char byte;
+  iovec iov{&byte, 1};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * 16)];
+
+  msghdr hdr{};
+  hdr.msg_iov = &iov;
+  hdr.msg_iovlen = 1;
+  hdr.msg_control = control;
+  hdr.msg_controllen = sizeof(control);
+
+  ssize_t res;
+  do {
+    res = ::recvmsg(sock, &hdr, MSG_CMSG_CLOEXEC);
+  } while (res < 0 && errno == EINTR);
+  if (res <= 0) return 0;
+
+  size_t n = 0;
+  for (cmsghdr* cm = CMSG_FIRSTHDR(&hdr); cm; cm = CMSG_NXTHDR(&hdr, cm)) {
+    if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS) continue;
+    size_t count = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    for (size_t i = 0; i < count; ++i) {
+      int fd;
+      std::memcpy(&fd, CMSG_DATA(cm) + i * sizeof(int), sizeof(int));
+      if (n < fds.size()) {
+        fds[n++] = fd;
+      } else {
+        ::close(fd);
+      }
+    }
+  }
+  return n;
+}
+
+}  // namespace hula
@@ -1,16 +1,35 @@
 #pragma once
 
 #include "closer.h"
+#include "trace.h"
 
 #include <algorithm>
 #include <cassert>
 #include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
 #include <type_traits>
 #include <utility>
 #include <vector>
 
 namespace hula {
 
+// wraps a signal argument type to deliver it to slots by value rather than by
+// const reference. the fired argument is copied into every slot but the last,
+// which receives it moved.
+template <class T>
+struct by_value {};
+
+// as the last argument of a signal, makes it a distinct type which only
+// documents its purpose, e.g. signal<order, tag<struct filled_tag>>. slots
+// never see the tag.
+template <class Tag>
+struct tag {};
+
+template <class Tag, class... Args>
+class basic_signal;
+
 namespace detail {
 
 template <class T, class Tag = void>
@@ -23,24 +42,107 @@ struct slot_picker<void, Tag> {
   using type = std::function<void()>;
 };
 
+template <class T>
+struct signal_arg {
+  using type = const T&;
+  using value = std::remove_cvref_t<T>;
+
+  static const T& last(const T& arg) { return arg; }
+};
+
+template <class T>
+struct signal_arg<by_value<T>> {
+  using type = T;
+  using value = T;
+
+  static T&& last(T& arg) { return std::move(arg); }
+};
+
+// signals of several arguments have no batch slots
+struct no_batch_slot {};
+
+template <class... Args>
+struct batch_picker {
+  using value = no_batch_slot;
+  using type = no_batch_slot;
+};
+
+template <class T>
+struct batch_picker<T> {
+  using value = typename signal_arg<T>::value;
+  using type = std::function<void(std::span<const value>)>;
+};
+
+template <class T>
+struct is_tag : std::false_type {};
+
+template <class Tag>
+struct is_tag<tag<Tag>> : std::true_type {};
+
+template <class... Args>
+struct type_list {};
+
+// walks the arguments of a signal, splitting off a trailing tag
+template <class Done, class... Rest>
+struct signal_base;
+
+template <class... Done>
+struct signal_base<type_list<Done...>> {
+  using type = basic_signal<void, Done...>;
+};
+
+template <class... Done, class Tag>
+struct signal_base<type_list<Done...>, tag<Tag>> {
+  using type = basic_signal<Tag, Done...>;
+};
+
+template <class... Done, class A, class... Rest>
+struct signal_base<type_list<Done...>, A, Rest...>
+    : signal_base<type_list<Done..., A>, Rest...> {};
+
+// signal<void> and signal<void, tag<Tag>> take no arguments
+template <>
+struct signal_base<type_list<>, void> {
+  using type = basic_signal<void>;
+};
+
+template <class Tag>
+struct signal_base<type_list<>, void, tag<Tag>> {
+  using type = basic_signal<Tag>;
+};
+
 }  // namespace detail
 
 template <class T = void, class Tag = void>
 using slot = typename detail::slot_picker<T, Tag>::type;
 
-// signal which can fire, calling all connected slots with argument of type T.
-// closing the returned closer will disconnect.
-template <class T = void, class Tag = void>
-class signal {
+// the signal implementation, with Tag split off the arguments. use signal.
+template <class Tag, class... Args>
+class basic_signal {
+  static_assert(!(detail::is_tag<Args>::value || ...),
+                "hula::signal => tag<Tag> must be the last argument");
+
  public:
-  using slot_type = slot<T, Tag>;
+  using slot_type =
+      std::function<void(typename detail::signal_arg<Args>::type...)>;
+  // receives the whole span of fire_batch in one call, and a span of one
+  // item from each single fire
+  using batch_slot_type = typename detail::batch_picker<Args...>::type;
+  using batch_value_type = typename detail::batch_picker<Args...>::value;
+
+  static constexpr bool k_batchable = sizeof...(Args) == 1;
 
-  template <class U = T, typename = std::enable_if<std::is_void_v<T>>>
-  void operator()() {
+  void operator()(typename detail::signal_arg<Args>::type... args) {
+    trace::span span("signal", "hula.signal");
     _during_call = true;
 
-    for (auto& sub : _slots) {
-      sub();
+    // slots connected during the call are pending, so the size is stable
+    const size_t n = _slots.size();
+    for (size_t i = 0; i + 1 < n; ++i) {
+      _slots[i](args...);
+    }
+    if (n > 0) {
+      _slots[n - 1](detail::signal_arg<Args>::last(args)...);
     }
 
     _during_call = false;
@@ -48,12 +150,25 @@ class signal {
     do_pending_connects();
   }
 
-  template <class U = T, typename = std::enable_if<!std::is_void_v<T>>>
-  void operator()(U&& arg) {
+  // fire once for every item, in order. item slots see exactly what firing
+  // each item separately would do: every slot gets the first item, then
+  // every slot the second, and so on. batch slots are called after that,
+  // once each with the whole span.
+  // connections and disconnections made by the slots take effect after the
+  // batch.
+  void fire_batch(std::span<const batch_value_type> items)
+    requires k_batchable
+  {
+    trace::span span("signal_batch", "hula.signal");
     _during_call = true;
 
+    for (const auto& item : items) {
+      for (auto& sub : _slots) {
+        if (!sub._batch) sub(item);
+      }
+    }
     for (auto& sub : _slots) {
-      sub(std::forward<U>(arg));
+      if (sub._active && sub._batch) sub._batch(items);
     }
 
     _during_call = false;
@@ -63,21 +178,12 @@ class signal {
 
   // closing the handle will guarantee that the slot will not be triggered
   // afterwards
-  closer connect(slot_type s) {
-    auto id = _next_id++;
-    if (_during_call) {
-      _pending_connections.emplace_back(slot_info{
-          ._id = id,
-          ._slot = s,
-      });
-    } else {
-      _slots.emplace_back(slot_info{
-          ._id = id,
-          ._slot = s,
-      });
-    }
+  closer connect(slot_type s) { return add(slot_info{._slot = s}); }
 
-    return closer([=, this]() { disconnect(id); });
+  closer connect_batch(batch_slot_type s)
+    requires k_batchable
+  {
+    return add(slot_info{._batch = s});
   }
 
  private:
@@ -120,20 +226,35 @@ class signal {
   }
 
   struct slot_info {
-    uint64_t _id;
+    uint64_t _id = 0;
     slot_type _slot;
+    batch_slot_type _batch;
     bool _active = true;
 
-    template <class U = T, typename = std::enable_if<std::is_void_v<T>, void>>
-    void operator()() {
-      if (_active) _slot();
+    template <class... U>
+    void operator()(U&&... args) {
+      if (!_active) return;
+      if constexpr (k_batchable) {
+        if (_batch) {
+          (_batch(std::span(std::addressof(args), 1)), ...);
+          return;
+        }
+      }
+      _slot(std::forward<U>(args)...);
     }
+  };
 
-    template <class U = T, typename = std::enable_if<!std::is_void_v<T>, void>>
-    void operator()(U&& arg) {
-      if (_active) _slot(std::forward<U>(arg));
+  closer add(slot_info info) {
+    auto id = _next_id++;
+    info._id = id;
+    if (_during_call) {
+      _pending_connections.emplace_back(std::move(info));
+    } else {
+      _slots.emplace_back(std::move(info));
     }
-  };
+
+    return closer([=, this]() { disconnect(id); });
+  }
 
   uint64_t _next_id = 0;
   std::vector<slot_info> _slots;
@@ -143,4 +264,13 @@ class signal {
   std::vector<uint64_t> _pending_disconnections;
 };
 
+// signal which can fire, calling all connected slots with arguments of types
+// Args. arguments are delivered as const Args&, so firing never copies them,
+// unless wrapped in by_value. a trailing tag<Tag> only distinguishes the
+// type. signal<void> is the same as signal<>.
+// closing the returned closer will disconnect.
+template <class... Args>
+class signal : public detail::signal_base<detail::type_list<>, Args...>::type {
+};
+
 }  // namespace hula
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "sys.h"
+
+#if !defined(_HULA_LINUX)
+#error "hula::without_sigpipe requires linux (sigtimedwait)"
+#endif
+
+#include <cerrno>
+#include <csignal>
+#include <ctime>
+
+#include <pthread.h>
+
+namespace hula {
+
+// runs write_fn, a write which may hit a pipe or socket whose reader is
+// gone, with SIGPIPE blocked on the calling thread so it fails with EPIPE
+// instead of killing the process. a SIGPIPE it raised is consumed before the
+// mask is restored, one already pending is left alone. errno is kept.
+// sockets written with send can use MSG_NOSIGNAL instead.
+template <class F>
+auto without_sigpipe(F&& write_fn) {
+  sigset_t pipe_set;
+  sigemptyset(&pipe_set);
+  sigaddset(&pipe_set, SIGPIPE);
+  sigset_t pending;
+  sigemptyset(&pending);
+  ::sigpending(&pending);
+  const bool was_pending = sigismember(&pending, SIGPIPE);
+  sigset_t old;
+  ::pthread_sigmask(SIG_BLOCK, &pipe_set, &old);
+
+  auto res = write_fn();
+  const int err = errno;
+  if (res < 0 && err == EPIPE && !was_pending) {
+    const timespec zero{};
+    while (::sigtimedwait(&pipe_set, nullptr, &zero) < 0 && errno == EINTR) {
+    }
+  }
+  ::pthread_sigmask(SIG_SETMASK, &old, nullptr);
+  errno = err;
+  return res;
+}
+
+}  // namespace hula
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <span>
+#include <tuple>
+#include <utility>
+
+namespace hula {
+
+// signal with a fixed set of slots known at compile time, e.g. a risk check,
+// a logger and a publisher. firing calls every slot in order through a fold
+// expression, without std::function indirection, so the compiler can inline
+// the whole dispatch. slots cannot be connected or disconnected; use
+// hula::signal for that.
+template <class T, class... Slots>
+class static_signal {
+ public:
+  explicit static_signal(Slots... slots) : _slots(std::move(slots)...) {}
+
+  void operator()(const T& arg) {
+    std::apply([&](auto&... slot) { (slot(arg), ...); }, _slots);
+  }
+
+  // fire once for every item, in order, like hula::signal::fire_batch:
+  // every slot gets the first item, then every slot the second, and so on
+  void fire_batch(std::span<const T> items) {
+    for (const auto& item : items) (*this)(item);
+  }
+
+  template <size_t I>
+  auto& get() {
+    return std::get<I>(_slots);
+  }
+
+  static constexpr size_t size() { return sizeof...(Slots); }
+
+ private:
+  std::tuple<Slots...> _slots;
+};
+
+template <class T, class... Slots>
+static_signal<T, Slots...> make_static_signal(Slots... slots) {
+  return static_signal<T, Slots...>(std::move(slots)...);
+}
+
+}  // namespace hula
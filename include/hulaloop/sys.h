@@ -9,6 +9,10 @@ enum class sys_type { unix, mac };
 #define _HULA_UNIX
 static constexpr sys_type sys = sys_type::unix;
 
+#if defined(__linux__)
+#define _HULA_LINUX
+#endif
+
 #elif defined(__APPLE__)
 
 #define _HULA_MAC
@@ -0,0 +1,269 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+namespace hula::trace {
+
+// a single trace record. names must have static storage duration.
+struct event {
+  const char* name = nullptr;
+  const char* category = nullptr;
+  int64_t ts_ns = 0;
+  int64_t arg = -1;
+  char phase = 'i';  // chrome trace phases: B(egin), E(nd), i(nstant)
+};
+
+// fixed size single producer single consumer ring of events.
+// the producer is the owning thread, the consumer is whoever flushes.
+// when full new events are dropped and counted.
+class ring {
+ public:
+  explicit ring(size_t capacity, uint32_t tid)
+      : _mask(round_up(capacity) - 1), _events(_mask + 1), _tid(tid) {}
+
+  void push(const event& ev) {
+    auto head = _head.load(std::memory_order_relaxed);
+    if (head - _tail.load(std::memory_order_acquire) > _mask) {
+      _dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    _events[head & _mask] = ev;
+    _head.store(head + 1, std::memory_order_release);
+  }
+
+  // pops all available events
+  template <class F>
+  void drain(F&& f) {
+    auto tail = _tail.load(std::memory_order_relaxed);
+    auto head = _head.load(std::memory_order_acquire);
+    for (; tail != head; ++tail) f(_events[tail & _mask]);
+    _tail.store(tail, std::memory_order_release);
+  }
+
+  uint32_t tid() const { return _tid; }
+  uint64_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+ private:
+  static size_t round_up(size_t n) {
+    size_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+  }
+
+  std::atomic<uint64_t> _head{0};
+  std::atomic<uint64_t> _tail{0};
+  std::atomic<uint64_t> _dropped{0};
+  size_t _mask;
+  std::vector<event> _events;
+  uint32_t _tid;
+};
+
+class tracer;
+
+namespace detail {
+inline std::atomic<tracer*> active_tracer{nullptr};
+inline std::atomic<uint64_t> next_generation{1};
+}  // namespace detail
+
+// the installed tracer, or nullptr when tracing is disabled
+inline tracer* active() {
+  return detail::active_tracer.load(std::memory_order_relaxed);
+}
+
+// records events from any thread into per-thread rings, which can be flushed
+// on demand as chrome trace-event json (loadable by perfetto).
+class tracer {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  explicit tracer(size_t events_per_thread = 1 << 16)
+      : _capacity(events_per_thread) {}
+
+  // the tracer must outlive every span recording into it: a span keeps a
+  // pointer to the tracer it began on, even across uninstall().
+  ~tracer() {
+    uninstall();
+    assert(_open_spans.load() == 0 && "hula::trace::tracer => destroyed "
+                                      "while spans are open");
+  }
+
+  tracer(const tracer&) = delete;
+  tracer& operator=(const tracer&) = delete;
+
+  // make this the active tracer, enabling all trace points
+  void install() { detail::active_tracer.store(this); }
+
+  void uninstall() {
+    tracer* self = this;
+    detail::active_tracer.compare_exchange_strong(self, nullptr);
+  }
+
+  void begin(const char* name, const char* category, int64_t arg = -1) {
+    record('B', name, category, arg);
+  }
+
+  void end(const char* name, const char* category, int64_t arg = -1) {
+    record('E', name, category, arg);
+  }
+
+  void instant(const char* name, const char* category, int64_t arg = -1) {
+    record('i', name, category, arg);
+  }
+
+  // number of events dropped because a thread's ring was full
+  uint64_t dropped() const {
+    std::lock_guard lock(_mutex);
+    uint64_t n = 0;
+    for (const auto& r : _rings) n += r->dropped();
+    return n;
+  }
+
+  // drains every ring, writing a chrome trace-event json document
+  void write_json(std::ostream& os) {
+    std::lock_guard lock(_mutex);
+    const auto pid = ::getpid();
+
+    os << "{\"traceEvents\":[";
+    bool first = true;
+    for (auto& r : _rings) {
+      r->drain([&](const event& ev) {
+        if (!first) os << ",";
+        first = false;
+
+        char ts[32];
+        std::snprintf(ts, sizeof(ts), "%.3f", ev.ts_ns / 1000.0);
+
+        os << "\n{\"name\":";
+        write_string(os, ev.name);
+        os << ",\"cat\":";
+        write_string(os, ev.category);
+        os << ",\"ph\":\"" << ev.phase << "\",\"ts\":" << ts
+           << ",\"pid\":" << pid << ",\"tid\":" << r->tid();
+        if (ev.phase == 'i') os << ",\"s\":\"t\"";
+        if (ev.arg >= 0) os << ",\"args\":{\"id\":" << ev.arg << "}";
+        os << "}";
+      });
+    }
+    os << "\n],\"displayTimeUnit\":\"ns\"}\n";
+  }
+
+ private:
+  void record(char phase, const char* name, const char* category,
+              int64_t arg) {
+    ring& r = local_ring();
+    r.push(event{
+        .name = name,
+        .category = category,
+        .ts_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     clock::now().time_since_epoch())
+                     .count(),
+        .arg = arg,
+        .phase = phase,
+    });
+  }
+
+  // the calling thread's ring. the thread_local caches the last tracer used,
+  // switching tracers finds the thread's existing ring rather than adding one.
+  ring& local_ring() {
+    struct cache {
+      uint64_t _generation = 0;
+      ring* _ring = nullptr;
+    };
+    thread_local cache c;
+    if (c._generation != _generation) [[unlikely]] {
+      std::lock_guard lock(_mutex);
+      auto id = std::this_thread::get_id();
+      auto it = std::find_if(_owners.begin(), _owners.end(),
+                             [&](const auto& o) { return o.first == id; });
+      if (it != _owners.end()) {
+        c._ring = it->second;
+      } else {
+        auto tid = static_cast<uint32_t>(_rings.size() + 1);
+        _rings.emplace_back(std::make_unique<ring>(_capacity, tid));
+        c._ring = _rings.back().get();
+        _owners.emplace_back(id, c._ring);
+      }
+      c._generation = _generation;
+    }
+    return *c._ring;
+  }
+
+  static void write_string(std::ostream& os, const char* s) {
+    os << '"';
+    for (; s && *s; ++s) {
+      switch (*s) {
+        case '"':
+          os << "\\\"";
+          break;
+        case '\\':
+          os << "\\\\";
+          break;
+        default:
+          if (static_cast<unsigned char>(*s) < 0x20) {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", *s);
+            os << buf;
+          } else {
+            os << *s;
+          }
+      }
+    }
+    os << '"';
+  }
+
+  // distinguishes tracers which reuse the same address
+  const uint64_t _generation = detail::next_generation.fetch_add(1);
+  size_t _capacity;
+  mutable std::mutex _mutex;
+  std::vector<std::unique_ptr<ring>> _rings;
+  std::vector<std::pair<std::thread::id, ring*>> _owners;
+  // spans begun on this tracer and not yet ended
+  std::atomic<int64_t> _open_spans{0};
+
+  friend class span;
+};
+
+// records a named span for the lifetime of the object.
+// costs a single branch when tracing is disabled.
+class span {
+ public:
+  explicit span(const char* name, const char* category = "user",
+                int64_t arg = -1)
+      : _tracer(active()), _name(name), _category(category), _arg(arg) {
+    if (_tracer) [[unlikely]] {
+      _tracer->_open_spans.fetch_add(1, std::memory_order_relaxed);
+      _tracer->begin(_name, _category, _arg);
+    }
+  }
+
+  ~span() {
+    if (_tracer) [[unlikely]] {
+      _tracer->end(_name, _category, _arg);
+      _tracer->_open_spans.fetch_sub(1, std::memory_order_release);
+    }
+  }
+
+  span(const span&) = delete;
+  span& operator=(const span&) = delete;
+
+ private:
+  tracer* _tracer;
+  const char* _name;
+  const char* _category;
+  int64_t _arg;
+};
+
+}  // namespace hula::trace
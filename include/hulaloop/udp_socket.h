@@ -0,0 +1,368 @@
+#pragma once
+
+#include "loop.h"
+#include "net.h"
+#include "rx_timestamp.h"
+#include "signal.h"
+#include "sys.h"
+
+#if !defined(_HULA_LINUX)
+#error "hula::udp_socket requires linux (recvmmsg/sendmmsg)"
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace hula {
+
+// a received datagram, valid only for the duration of the slot call
+struct datagram {
+  std::span<const std::byte> data;
+  const sockaddr_storage* from = nullptr;
+  socklen_t from_len = 0;
+  // with gro enabled, data may hold several datagrams of this size coalesced
+  // by the kernel (the last one may be shorter). 0 if not coalesced.
+  uint16_t segment_size = 0;
+  // when the kernel received the datagram, with the timestamps option
+  std::optional<net::kernel_time> kernel_time;
+};
+
+// a udp socket registered with the loop. incoming datagrams are drained in
+// batches with recvmmsg, outgoing datagrams are queued and flushed with
+// sendmmsg once per cycle.
+template <class Clock = std::chrono::steady_clock>
+class udp_socket {
+ public:
+  using clock = Clock;
+  using datagrams_slot =
+      slot<std::span<const datagram>, struct udp_datagrams_slot_tag>;
+
+  struct options {
+    // datagrams received per recvmmsg call
+    size_t batch_size = 64;
+    // receive buffer per datagram, datagrams larger than this are truncated
+    size_t max_datagram_size = 2048;
+    // recvmmsg calls per readable callback before yielding to other fds
+    size_t max_batches_per_cycle = 4;
+    // let the kernel coalesce datagrams of a flow (UDP_GRO).
+    // max_datagram_size should be raised to 65535 when enabled.
+    bool gro = false;
+    // software rx timestamps (SO_TIMESTAMPNS), delivered with each datagram
+    // and recorded in the loop's rx_delay histogram
+    bool timestamps = false;
+  };
+
+  explicit udp_socket(loop<clock>& l, datagrams_slot slot)
+      : udp_socket(l, slot, options{}) {}
+
+  explicit udp_socket(loop<clock>& l, datagrams_slot slot, options opts)
+      : _loop(l), _slot(slot), _options(opts) {
+    _options.batch_size =
+        std::clamp<size_t>(_options.batch_size, 1, k_max_batch);
+
+    const size_t n = _options.batch_size;
+    _rx_buffer.resize(n * _options.max_datagram_size);
+    _rx_iovecs.resize(n);
+    _rx_msgs.resize(n);
+    _rx_addrs.resize(n);
+    _rx_control.resize(n * k_rx_control_size);
+    _rx_datagrams.resize(n);
+  }
+
+  ~udp_socket() { close(); }
+
+  udp_socket(const udp_socket&) = delete;
+  udp_socket& operator=(const udp_socket&) = delete;
+
+  // bind to the given ipv4 or ipv6 address and start receiving.
+  // a port of 0 binds an ephemeral port, see port().
+  void bind(const std::string& address, uint16_t port) {
+    auto addr = net::address::parse(address, port);
+    open(addr.family());
+    if (::bind(_fd, addr.get(), addr.len) != 0) fail("bind");
+  }
+
+  // set the default destination for send(data). binds an ephemeral port if
+  // the socket is not yet open.
+  void connect(const std::string& address, uint16_t port) {
+    auto addr = net::address::parse(address, port);
+    if (_fd < 0) open(addr.family());
+    if (::connect(_fd, addr.get(), addr.len) != 0) fail("connect");
+  }
+
+  void close() {
+    _closer.close();
+    _flush_closer.close();
+    if (_fd >= 0) ::close(_fd);
+    _fd = -1;
+    _tx_queue.clear();
+    _tx_buffer.clear();
+  }
+
+  int fd() const { return _fd; }
+
+  uint16_t port() const {
+    return _fd < 0 ? 0 : net::address::local(_fd).port();
+  }
+
+  // queue a datagram to the connected peer
+  void send(std::span<const std::byte> data) { queue(data, nullptr, 0, 0); }
+
+  // queue a datagram to the given destination
+  void send(std::span<const std::byte> data, const net::address& to) {
+    queue(data, to.get(), to.len, 0);
+  }
+
+  // queue a buffer which the kernel splits into datagrams of segment_size
+  // (UDP_SEGMENT), i.e. one syscall and one queue entry for many datagrams.
+  void send_segmented(std::span<const std::byte> data, uint16_t segment_size,
+                      const net::address& to) {
+    queue(data, to.get(), to.len, segment_size);
+  }
+
+  // send everything queued now rather than at the end of the cycle
+  void flush() {
+    _flush_closer.close();
+    if (_fd < 0) return;
+
+    size_t sent = 0;
+    while (sent < _tx_queue.size()) {
+      size_t n = std::min<size_t>(_tx_queue.size() - sent, k_max_batch);
+      prepare_tx(sent, n);
+
+      int res = ::sendmmsg(_fd, _tx_msgs.data(), n, MSG_DONTWAIT);
+      _sendmmsg_calls++;
+      if (res < 0) {
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+        // drop the datagram which failed, e.g. unreachable destination
+        _send_errors++;
+        sent++;
+        continue;
+      }
+      sent += res;
+      _datagrams_sent += res;
+    }
+
+    if (sent == _tx_queue.size()) {
+      _tx_queue.clear();
+      _tx_buffer.clear();
+      if (_want_write) set_want_write(false);
+      return;
+    }
+
+    // socket buffer full, wait until writable
+    _tx_queue.erase(_tx_queue.begin(), _tx_queue.begin() + sent);
+    if (!_want_write) set_want_write(true);
+  }
+
+  // datagrams queued and not yet sent
+  size_t queued() const { return _tx_queue.size(); }
+
+  uint64_t datagrams_received() const { return _datagrams_received; }
+  uint64_t datagrams_sent() const { return _datagrams_sent; }
+  uint64_t recvmmsg_calls() const { return _recvmmsg_calls; }
+  uint64_t sendmmsg_calls() const { return _sendmmsg_calls; }
+  uint64_t send_errors() const { return _send_errors; }
+
+ private:
+  // the kernel's limit on messages per recvmmsg/sendmmsg (UIO_MAXIOV)
+  static constexpr size_t k_max_batch = 1024;
+  static constexpr size_t k_control_size = CMSG_SPACE(sizeof(uint16_t));
+  static constexpr size_t k_rx_control_size =
+      k_control_size + net::k_timestamp_control_size;
+
+  struct queued_datagram {
+    size_t offset = 0;
+    size_t len = 0;
+    sockaddr_storage to{};
+    socklen_t to_len = 0;
+    uint16_t segment_size = 0;
+  };
+
+  void open(int family) {
+    close();
+    _fd = ::socket(family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (_fd < 0) fail("socket");
+
+    if (_options.gro) {
+      int one = 1;
+      if (::setsockopt(_fd, SOL_UDP, UDP_GRO, &one, sizeof(one)) != 0) {
+        fail("setsockopt(UDP_GRO)");
+      }
+    }
+    if (_options.timestamps && !net::enable_rx_timestamps(_fd)) {
+      fail("setsockopt(SO_TIMESTAMPNS)");
+    }
+
+    _closer = _loop.add_fd(_fd,
+                           fd_slots{
+                               .readable = [this](int) { drain(); },
+                               .writable = [this](int) { flush(); },
+                           },
+                           fd_events::read);
+  }
+
+  void queue(std::span<const std::byte> data, const sockaddr* to,
+             socklen_t to_len, uint16_t segment_size) {
+    if (_fd < 0) {
+      throw std::runtime_error("hula::udp_socket => send on closed socket");
+    }
+
+    queued_datagram q{
+        .offset = _tx_buffer.size(),
+        .len = data.size(),
+        .to_len = to_len,
+        .segment_size = segment_size,
+    };
+    if (to) std::memcpy(&q.to, to, to_len);
+    _tx_buffer.insert(_tx_buffer.end(), data.begin(), data.end());
+    _tx_queue.push_back(q);
+
+    // flush once, after this cycle's fd processing
+    if (!_flush_closer) _flush_closer = _loop.schedule([this] { flush(); });
+  }
+
+  void prepare_tx(size_t first, size_t n) {
+    _tx_iovecs.resize(n);
+    _tx_msgs.resize(n);
+    _tx_control.resize(n * k_control_size);
+
+    for (size_t i = 0; i < n; ++i) {
+      auto& q = _tx_queue[first + i];
+      _tx_iovecs[i] = iovec{_tx_buffer.data() + q.offset, q.len};
+
+      msghdr& hdr = _tx_msgs[i].msg_hdr;
+      hdr = msghdr{};
+      hdr.msg_name = q.to_len ? &q.to : nullptr;
+      hdr.msg_namelen = q.to_len;
+      hdr.msg_iov = &_tx_iovecs[i];
+      hdr.msg_iovlen = 1;
+
+      if (q.segment_size) {
+        hdr.msg_control = _tx_control.data() + i * k_control_size;
+        hdr.msg_controllen = k_control_size;
+        cmsghdr* cm = CMSG_FIRSTHDR(&hdr);
+        cm->cmsg_level = SOL_UDP;
+        cm->cmsg_type = UDP_SEGMENT;
+        cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        std::memcpy(CMSG_DATA(cm), &q.segment_size, sizeof(uint16_t));
+      }
+    }
+  }
+
+  void drain() {
+    const size_t n = _options.batch_size;
+    for (size_t batch = 0; batch < _options.max_batches_per_cycle; ++batch) {
+      for (size_t i = 0; i < n; ++i) {
+        _rx_iovecs[i] =
+            iovec{_rx_buffer.data() + i * _options.max_datagram_size,
+                  _options.max_datagram_size};
+        msghdr& hdr = _rx_msgs[i].msg_hdr;
+        hdr = msghdr{};
+        hdr.msg_name = &_rx_addrs[i];
+        hdr.msg_namelen = sizeof(sockaddr_storage);
+        hdr.msg_iov = &_rx_iovecs[i];
+        hdr.msg_iovlen = 1;
+        if (_options.gro || _options.timestamps) {
+          hdr.msg_control = _rx_control.data() + i * k_rx_control_size;
+          hdr.msg_controllen = k_rx_control_size;
+        }
+      }
+
+      int res = ::recvmmsg(_fd, _rx_msgs.data(), n, MSG_DONTWAIT, nullptr);
+      _recvmmsg_calls++;
+      if (res <= 0) return;
+
+      for (int i = 0; i < res; ++i) {
+        const msghdr& hdr = _rx_msgs[i].msg_hdr;
+        _rx_datagrams[i] = datagram{
+            .data = std::span<const std::byte>(
+                static_cast<const std::byte*>(_rx_iovecs[i].iov_base),
+                _rx_msgs[i].msg_len),
+            .from = &_rx_addrs[i],
+            .from_len = hdr.msg_namelen,
+            .segment_size = gro_segment_size(hdr),
+        };
+        if (_options.timestamps) {
+          auto& t = _rx_datagrams[i].kernel_time;
+          t = net::rx_timestamp(hdr);
+          if (t) _loop.record_rx_delay(net::rx_delay(*t));
+        }
+      }
+      _datagrams_received += res;
+
+      _slot(std::span<const datagram>(_rx_datagrams.data(), res));
+
+      // the slot may have closed us
+      if (_fd < 0 || static_cast<size_t>(res) < n) return;
+    }
+  }
+
+  uint16_t gro_segment_size(const msghdr& hdr) const {
+    if (!_options.gro) return 0;
+    for (cmsghdr* cm = CMSG_FIRSTHDR(&hdr); cm;
+         cm = CMSG_NXTHDR(const_cast<msghdr*>(&hdr), cm)) {
+      if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO) {
+        uint16_t size = 0;
+        std::memcpy(&size, CMSG_DATA(cm), sizeof(size));
+        return size;
+      }
+    }
+    return 0;
+  }
+
+  void set_want_write(bool want) {
+    _want_write = want;
+    _loop.update_fd(_fd, want ? fd_events::read_write : fd_events::read);
+  }
+
+  [[noreturn]] void fail(const char* what) {
+    std::string msg = std::string("hula::udp_socket => ") + what +
+                      " failed: " + std::strerror(errno);
+    close();
+    throw std::runtime_error(msg);
+  }
+
+  loop<clock>& _loop;
+  datagrams_slot _slot;
+  options _options;
+  int _fd = -1;
+  closer _closer;
+  closer _flush_closer;
+  bool _want_write = false;
+
+  // receive state, preallocated for a full batch
+  std::vector<std::byte> _rx_buffer;
+  std::vector<iovec> _rx_iovecs;
+  std::vector<mmsghdr> _rx_msgs;
+  std::vector<sockaddr_storage> _rx_addrs;
+  std::vector<std::byte> _rx_control;
+  std::vector<datagram> _rx_datagrams;
+
+  // send state
+  std::vector<std::byte> _tx_buffer;
+  std::vector<queued_datagram> _tx_queue;
+  std::vector<iovec> _tx_iovecs;
+  std::vector<mmsghdr> _tx_msgs;
+  std::vector<std::byte> _tx_control;
+
+  uint64_t _datagrams_received = 0;
+  uint64_t _datagrams_sent = 0;
+  uint64_t _recvmmsg_calls = 0;
+  uint64_t _sendmmsg_calls = 0;
+  uint64_t _send_errors = 0;
+};
+
+}  // namespace hula
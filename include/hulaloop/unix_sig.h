@@ -48,7 +48,7 @@ enum class sig {
   sigusr2 = SIGUSR2
 };
 
-using signal = hula::signal<void, struct sig_slot_tag>;
+using signal = hula::signal<>;
 
 class signal_registry {
  public:
@@ -0,0 +1,188 @@
+#pragma once
+
+#include "heartbeat.h"
+#include "loop.h"
+#include "signal.h"
+#include "unix_sig.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include <execinfo.h>
+#include <pthread.h>
+
+namespace hula {
+
+// a loop phase which ran for longer than the watchdog threshold
+struct stall_event {
+  loop_phase phase = loop_phase::idle;
+  // fd, timer id or signal number depending on the phase, -1 if none
+  int64_t id = -1;
+  const char* label = nullptr;
+  std::chrono::steady_clock::time_point started;
+  // updated once the stall ends
+  std::chrono::nanoseconds duration{};
+  // loop thread stack at detection time, if backtraces are enabled
+  std::vector<void*> backtrace;
+};
+
+// watches the heartbeat of a loop from a separate thread and records a
+// stall_event whenever a single phase (or registration within it) runs for
+// longer than the threshold.
+template <class Clock = std::chrono::steady_clock>
+class watchdog {
+ public:
+  using stall_slot = slot<const stall_event&, struct stall_slot_tag>;
+
+  explicit watchdog(loop<Clock>& l, std::chrono::nanoseconds threshold)
+      : _loop(l), _threshold(threshold) {}
+
+  ~watchdog() { stop(); }
+
+  watchdog(const watchdog&) = delete;
+  watchdog& operator=(const watchdog&) = delete;
+
+  // called from the watchdog thread when a stall is first detected.
+  // must be set before start().
+  void set_stall_slot(stall_slot s) { _stall_slot = s; }
+
+  // capture the loop thread's stack on detection by sending it the given
+  // signal. the signal must not be used elsewhere in the process.
+  // must be set before start().
+  void enable_backtraces(unix::sig s) { _backtrace_sig = s; }
+
+  // must be called from the thread which runs the loop
+  void start() {
+    if (_thread.joinable()) return;
+
+    _loop_thread = pthread_self();
+    if (_backtrace_sig) install_backtrace_handler(*_backtrace_sig);
+
+    _loop.set_heartbeat(&_heartbeat);
+    _stopping = false;
+    _thread = std::thread([this] { watch(); });
+  }
+
+  // must be called from the thread which runs the loop
+  void stop() {
+    if (!_thread.joinable()) return;
+
+    {
+      std::lock_guard lock(_mutex);
+      _stopping = true;
+    }
+    _cv.notify_all();
+    _thread.join();
+    _loop.set_heartbeat(nullptr);
+  }
+
+  // all stalls recorded so far
+  std::vector<stall_event> stalls() const {
+    std::lock_guard lock(_mutex);
+    return _stalls;
+  }
+
+ private:
+  void watch() {
+    const auto check_interval = std::max<std::chrono::nanoseconds>(
+        _threshold / 4, std::chrono::microseconds(100));
+
+    std::optional<uint64_t> open_seq;
+    size_t open_idx = 0;
+
+    std::unique_lock lock(_mutex);
+    while (!_cv.wait_for(lock, check_interval, [this] { return _stopping; })) {
+      auto state = _heartbeat.read();
+      auto now = std::chrono::steady_clock::now();
+
+      if (open_seq && *open_seq != state._seq) {
+        // the stall ended at the beat which replaced it
+        auto& ev = _stalls[open_idx];
+        ev.duration = state._since - ev.started;
+        open_seq.reset();
+      }
+
+      if (state._phase == loop_phase::idle || open_seq) continue;
+      if (now - state._since < _threshold) continue;
+
+      stall_event ev{
+          .phase = state._phase,
+          .id = state._id,
+          .label = state._label,
+          .started = state._since,
+          .duration = now - state._since,
+      };
+
+      lock.unlock();
+      if (_backtrace_sig) capture_backtrace(ev);
+      if (_stall_slot) _stall_slot(ev);
+      lock.lock();
+
+      _stalls.emplace_back(std::move(ev));
+      open_seq = state._seq;
+      open_idx = _stalls.size() - 1;
+    }
+  }
+
+  void capture_backtrace(stall_event& ev) {
+    backtrace_capture::depth.store(-1, std::memory_order_relaxed);
+    pthread_kill(_loop_thread, static_cast<int>(*_backtrace_sig));
+
+    // the loop thread may be blocked in the kernel, don't wait forever
+    auto give_up = std::chrono::steady_clock::now() + _threshold;
+    int depth = -1;
+    while ((depth = backtrace_capture::depth.load(std::memory_order_acquire)) <
+               0 &&
+           std::chrono::steady_clock::now() < give_up) {
+      std::this_thread::yield();
+    }
+    if (depth > 0) {
+      ev.backtrace.assign(backtrace_capture::frames,
+                          backtrace_capture::frames + depth);
+    }
+  }
+
+  struct backtrace_capture {
+    static constexpr int k_max_frames = 64;
+    static inline void* frames[k_max_frames];
+    static inline std::atomic<int> depth{-1};
+
+    static void handler(int) {
+      int n = ::backtrace(frames, k_max_frames);
+      depth.store(n, std::memory_order_release);
+    }
+  };
+
+  static void install_backtrace_handler(unix::sig s) {
+    // backtrace() may allocate on first use, which is not signal safe
+    void* warmup[1];
+    ::backtrace(warmup, 1);
+
+    struct sigaction sa{};
+    sa.sa_handler = &backtrace_capture::handler;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(static_cast<int>(s), &sa, nullptr);
+  }
+
+  loop<Clock>& _loop;
+  std::chrono::nanoseconds _threshold;
+  heartbeat _heartbeat;
+  stall_slot _stall_slot;
+  std::optional<unix::sig> _backtrace_sig;
+  pthread_t _loop_thread{};
+
+  std::thread _thread;
+  mutable std::mutex _mutex;
+  std::condition_variable _cv;
+  bool _stopping = false;
+  std::vector<stall_event> _stalls;
+};
+
+}  // namespace hula
@@ -4,6 +4,9 @@
 
 #include <chrono>
 
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
 namespace hula::test {
@@ -45,6 +48,8 @@ struct fake_clock_loop_test {
     _loop._stopping = false;
     _loop.do_cycle();
   }
+
+  bool work_to_do() const { return _loop.work_to_do(); }
 };
 
 // read write pair of fds from pipe()
@@ -75,4 +80,20 @@ class fd_pair {
   fd_slots _slots[2];
 };
 
+// blocking tcp connection to a port on 127.0.0.1
+inline int loopback_connect(uint16_t port) {
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) throw std::runtime_error("socket failed");
+
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    ::close(fd);
+    throw std::runtime_error("connect failed");
+  }
+  return fd;
+}
+
 }  // namespace hula::test
@@ -0,0 +1,96 @@
+#include "fakes.h"
+
+#include <hulaloop/acceptor.h>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <fcntl.h>
+
+namespace hula::test {
+
+TEST_CASE_METHOD(loop_test, "acceptor accepts batch", "[acceptor]") {
+  std::vector<int> accepted;
+  acceptor a(_loop, [&](std::span<const accepted_connection> conns) {
+    for (const auto& c : conns) accepted.push_back(c.fd);
+  });
+  a.listen("127.0.0.1", 0);
+  REQUIRE(a.port() != 0);
+
+  int c1 = loopback_connect(a.port());
+  int c2 = loopback_connect(a.port());
+  int c3 = loopback_connect(a.port());
+
+  cycle();
+  REQUIRE(accepted.size() == 3);
+  REQUIRE(a.accepted() == 3);
+  for (int fd : accepted) {
+    REQUIRE((::fcntl(fd, F_GETFL) & O_NONBLOCK));
+    REQUIRE((::fcntl(fd, F_GETFD) & FD_CLOEXEC));
+    ::close(fd);
+  }
+
+  ::close(c1);
+  ::close(c2);
+  ::close(c3);
+}
+
+TEST_CASE_METHOD(loop_test, "acceptor per cycle limit", "[acceptor]") {
+  std::vector<size_t> batches;
+  std::vector<int> accepted;
+  acceptor a(
+      _loop,
+      [&](std::span<const accepted_connection> conns) {
+        batches.push_back(conns.size());
+        for (const auto& c : conns) accepted.push_back(c.fd);
+      },
+      {.max_accepts_per_cycle = 2});
+  a.listen("127.0.0.1", 0);
+
+  std::vector<int> clients;
+  for (int i = 0; i < 3; ++i) clients.push_back(loopback_connect(a.port()));
+
+  cycle();
+  REQUIRE(batches == std::vector<size_t>{2});
+
+  cycle();
+  REQUIRE(batches == std::vector<size_t>{2, 1});
+
+  for (int fd : accepted) ::close(fd);
+  for (int fd : clients) ::close(fd);
+}
+
+TEST_CASE_METHOD(loop_test, "acceptor reuse port", "[acceptor]") {
+  int accepted = 0;
+  auto on_accept = [&](std::span<const accepted_connection> conns) {
+    for (const auto& c : conns) {
+      accepted++;
+      ::close(c.fd);
+    }
+  };
+
+  acceptor a1(_loop, on_accept, {.reuse_port = true});
+  a1.listen("127.0.0.1", 0);
+
+  acceptor a2(_loop, on_accept, {.reuse_port = true});
+  a2.listen("127.0.0.1", a1.port());
+  REQUIRE(a1.port() == a2.port());
+
+  acceptor a3(_loop, on_accept);
+  REQUIRE_THROWS(a3.listen("127.0.0.1", a1.port()));
+  REQUIRE(a3.fd() == -1);
+
+  std::vector<int> clients;
+  for (int i = 0; i < 8; ++i) clients.push_back(loopback_connect(a1.port()));
+
+  cycle();
+  REQUIRE(accepted == 8);
+
+  for (int fd : clients) ::close(fd);
+}
+
+TEST_CASE_METHOD(loop_test, "acceptor invalid address", "[acceptor]") {
+  acceptor a(_loop, [](std::span<const accepted_connection>) {});
+  REQUIRE_THROWS(a.listen("not an address", 0));
+}
+
+}  // namespace hula::test
@@ -0,0 +1,168 @@
+#include <hulaloop/async_log.h>
+
+#include <catch2/catch_test_macros.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace hula::test {
+
+using namespace std::chrono_literals;
+
+namespace {
+// an unlinked temporary file
+struct temp_file {
+  int fd = -1;
+
+  temp_file() {
+    char tmpl[] = "/tmp/hula_log_XXXXXX";
+    fd = ::mkstemp(tmpl);
+    if (fd < 0) throw std::runtime_error("mkstemp failed");
+    ::unlink(tmpl);
+  }
+
+  ~temp_file() { ::close(fd); }
+
+  std::string contents() const {
+    std::string out;
+    char buf[4096];
+    ssize_t n;
+    off_t off = 0;
+    while ((n = ::pread(fd, buf, sizeof(buf), off)) > 0) {
+      out.append(buf, n);
+      off += n;
+    }
+    return out;
+  }
+};
+
+size_t count_lines(const std::string& s) {
+  return std::count(s.begin(), s.end(), '\n');
+}
+}  // namespace
+
+TEST_CASE("async_log writes lines from many threads", "[async_log]") {
+  temp_file file;
+  {
+    async_log log(file.fd);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+      threads.emplace_back([&log, t] {
+        for (int i = 0; i < 1000; ++i) log.logf("thread %d line %d", t, i);
+      });
+    }
+    for (auto& t : threads) t.join();
+    log.write("raw\n");
+    log.flush();
+    REQUIRE(log.dropped() == 0);
+    REQUIRE(count_lines(file.contents()) == 4001);
+  }
+
+  auto contents = file.contents();
+  REQUIRE(contents.find("thread 3 line 999\n") != std::string::npos);
+  REQUIRE(contents.find("thread 0 line 0\n") != std::string::npos);
+}
+
+TEST_CASE("async_log lines wrap around the ring", "[async_log]") {
+  temp_file file;
+  std::string expected;
+  {
+    async_log log(file.fd, {.ring_size = 4096, .max_line = 100});
+    for (int i = 0; i < 500; ++i) {
+      std::string line = "line " + std::to_string(i) +
+                         std::string(static_cast<size_t>(i % 50), '.');
+      log.logf("%s", line.c_str());
+      expected += line + "\n";
+      if (i % 20 == 0) log.flush();
+    }
+  }
+  REQUIRE(file.contents() == expected);
+}
+
+TEST_CASE("async_log truncates long lines", "[async_log]") {
+  temp_file file;
+  {
+    async_log log(file.fd, {.max_line = 16});
+    log.logf("%s", std::string(100, 'x').c_str());
+  }
+  REQUIRE(file.contents() == std::string(15, 'x') + "\n");
+}
+
+TEST_CASE("async_log rejects a zero max_line", "[async_log]") {
+  temp_file file;
+  REQUIRE_THROWS_AS(async_log(file.fd, {.max_line = 0}),
+                    std::invalid_argument);
+}
+
+TEST_CASE("async_log reuses the rings of exited threads", "[async_log]") {
+  temp_file file;
+  {
+    async_log log(file.fd);
+    for (int i = 0; i < 20; ++i) {
+      std::thread([&] { log.logf("thread %d", i); }).join();
+      log.flush();
+    }
+    REQUIRE(log.rings() == 1);
+  }
+  REQUIRE(count_lines(file.contents()) == 20);
+}
+
+TEST_CASE("async_log destroyed before a logging thread exits",
+          "[async_log]") {
+  temp_file file;
+  auto log = std::make_unique<async_log>(file.fd);
+  std::thread t([&] {
+    log->logf("before");
+    log.reset();
+  });
+  t.join();
+  REQUIRE(file.contents() == "before\n");
+}
+
+TEST_CASE("async_log drops when full", "[async_log]") {
+  temp_file file;
+  async_log log(file.fd, {.ring_size = 4096,
+                          .overflow = log_overflow::drop,
+                          .flush_interval = 10s});
+  std::string line(100, 'x');
+  int accepted = 0;
+  for (int i = 0; i < 100; ++i) accepted += log.logf("%s", line.c_str());
+
+  REQUIRE(accepted < 100);
+  REQUIRE(log.dropped() == static_cast<uint64_t>(100 - accepted));
+  log.flush();
+  REQUIRE(count_lines(file.contents()) == static_cast<size_t>(accepted));
+}
+
+TEST_CASE("async_log blocks when full", "[async_log]") {
+  temp_file file;
+  {
+    async_log log(file.fd, {.ring_size = 4096,
+                            .overflow = log_overflow::block,
+                            .flush_interval = 10s});
+    std::string line(100, 'x');
+    for (int i = 0; i < 1000; ++i) REQUIRE(log.logf("%s", line.c_str()));
+    REQUIRE(log.dropped() == 0);
+  }
+  REQUIRE(count_lines(file.contents()) == 1000);
+}
+
+TEST_CASE("async_log timestamps", "[async_log]") {
+  temp_file file;
+  {
+    async_log log(file.fd);
+    auto t = std::chrono::system_clock::time_point(1700000000123456us);
+    log.logf_at(t, "hello %d", 42);
+  }
+  REQUIRE(file.contents() == "1700000000.123456 hello 42\n");
+}
+
+}  // namespace hula::test
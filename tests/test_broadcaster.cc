@@ -0,0 +1,180 @@
+#include "fakes.h"
+
+#include <hulaloop/broadcaster.h>
+
+#include <catch2/catch_test_macros.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+
+namespace hula::test {
+
+namespace {
+// a connected pair of unix stream sockets, with a small send buffer on the
+// broadcaster's side so it fills quickly
+struct socket_pair {
+  int fds[2] = {-1, -1};
+
+  socket_pair() {
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+      throw std::runtime_error("socketpair failed");
+    }
+    int size = 4096;
+    ::setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+  }
+
+  ~socket_pair() {
+    for (int fd : fds) {
+      if (fd >= 0) ::close(fd);
+    }
+  }
+};
+
+std::span<const std::byte> as_bytes(const std::string& s) {
+  return std::as_bytes(std::span(s.data(), s.size()));
+}
+
+std::string read_all(int fd) {
+  std::string out;
+  char buf[4096];
+  ssize_t n;
+  while ((n = ::recv(fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+    out.append(buf, n);
+  }
+  return out;
+}
+}  // namespace
+
+TEST_CASE_METHOD(loop_test, "broadcaster fans out one copy",
+                 "[broadcaster]") {
+  std::vector<socket_pair> pairs(3);
+  broadcaster b(_loop, [](const broadcast_disconnect&) {});
+  for (auto& p : pairs) b.subscribe(p.fds[0]);
+  REQUIRE(b.subscribers() == 3);
+
+  b.publish(as_bytes("hello "));
+  std::string world = "world";
+  auto bytes = as_bytes(world);
+  auto shared = std::make_shared<const std::vector<std::byte>>(bytes.begin(),
+                                                               bytes.end());
+  b.publish(shared);
+  REQUIRE(shared.use_count() == 4);
+  cycle();
+
+  for (auto& p : pairs) REQUIRE(read_all(p.fds[1]) == "hello world");
+  // every reference is released once written
+  REQUIRE(shared.use_count() == 1);
+  REQUIRE(b.statistics().published == 2);
+  REQUIRE(b.statistics().bytes_copied == 6);
+}
+
+TEST_CASE_METHOD(loop_test, "broadcaster resumes partial writes",
+                 "[broadcaster]") {
+  socket_pair p;
+  broadcaster b(_loop, [](const broadcast_disconnect&) {});
+  auto id = b.subscribe(p.fds[0]);
+
+  std::string expected;
+  for (int i = 0; i < 64; ++i) {
+    std::string msg(1000, static_cast<char>('a' + i % 26));
+    expected += msg;
+    b.publish(as_bytes(msg));
+  }
+  b.flush();
+  REQUIRE(b.queued(id) > 0);
+
+  std::string received;
+  for (int i = 0; i < 1000 && received.size() < expected.size(); ++i) {
+    received += read_all(p.fds[1]);
+    cycle();
+  }
+  REQUIRE(received == expected);
+  REQUIRE(b.queued(id) == 0);
+}
+
+TEST_CASE_METHOD(loop_test, "broadcaster drops for slow consumers",
+                 "[broadcaster]") {
+  socket_pair slow;
+  socket_pair fast;
+  broadcaster b(_loop, [](const broadcast_disconnect&) {},
+                {.max_queued = 4, .policy = slow_consumer_policy::drop});
+  auto slow_id = b.subscribe(slow.fds[0]);
+  b.subscribe(fast.fds[0]);
+
+  std::string msg(2000, 'x');
+  size_t fast_bytes = 0;
+  for (int i = 0; i < 32; ++i) {
+    b.publish(as_bytes(msg));
+    b.flush();
+    fast_bytes += read_all(fast.fds[1]).size();
+  }
+  REQUIRE(b.queued(slow_id) == 4);
+  REQUIRE(b.statistics().dropped > 0);
+  REQUIRE(fast_bytes == 32 * msg.size());
+}
+
+TEST_CASE_METHOD(loop_test, "broadcaster conflates to the latest message",
+                 "[broadcaster]") {
+  socket_pair p;
+  broadcaster b(_loop, [](const broadcast_disconnect&) {},
+                {.max_queued = 2, .policy = slow_consumer_policy::conflate});
+  auto id = b.subscribe(p.fds[0]);
+
+  // fill the socket so everything further stays queued
+  std::string filler(1000, '.');
+  while (b.queued(id) == 0) {
+    b.publish(as_bytes(filler));
+    b.flush();
+  }
+  for (char c = 'a'; c <= 'z'; ++c) b.publish(as_bytes(std::string(1, c)));
+  REQUIRE(b.queued(id) <= 2);
+  REQUIRE(b.statistics().conflated > 0);
+
+  std::string received;
+  for (int i = 0; i < 1000 && received.find('z') == std::string::npos; ++i) {
+    received += read_all(p.fds[1]);
+    cycle();
+  }
+  REQUIRE(received.back() == 'z');
+  REQUIRE(received.find('a') == std::string::npos);
+}
+
+TEST_CASE_METHOD(loop_test, "broadcaster disconnects", "[broadcaster]") {
+  socket_pair slow;
+  socket_pair gone;
+  std::vector<broadcast_disconnect> disconnects;
+  broadcaster b(
+      _loop,
+      [&](const broadcast_disconnect& d) { disconnects.push_back(d); },
+      {.max_queued = 1});
+  auto slow_id = b.subscribe(slow.fds[0]);
+  auto gone_id = b.subscribe(gone.fds[0]);
+
+  ::close(gone.fds[1]);
+  gone.fds[1] = -1;
+
+  std::string msg(8192, 'x');
+  for (int i = 0; i < 8 && b.subscribers() > 0; ++i) {
+    b.publish(as_bytes(msg));
+    b.flush();
+  }
+  REQUIRE(b.subscribers() == 0);
+  // notified on the next cycle
+  REQUIRE(disconnects.empty());
+  cycle();
+  REQUIRE(disconnects.size() == 2);
+  for (auto& d : disconnects) {
+    if (d.id == slow_id) {
+      REQUIRE(d.fd == slow.fds[0]);
+      REQUIRE(d.error == 0);
+    } else {
+      REQUIRE(d.id == gone_id);
+      REQUIRE(d.error == EPIPE);
+    }
+  }
+  REQUIRE(b.statistics().disconnected == 2);
+}
+
+}  // namespace hula::test
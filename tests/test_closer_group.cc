@@ -0,0 +1,119 @@
+#include "fakes.h"
+
+#include <hulaloop/closer_group.h>
+
+#include <catch2/catch_test_macros.hpp>
+#include <memory>
+#include <vector>
+
+namespace hula::test {
+
+TEST_CASE_METHOD(fake_clock_loop_test, "closer_group removes everything",
+                 "[closer_group]") {
+  fd_pair a, b;
+  int reads = 0, timers = 0, signals = 0;
+  signal<> sig;
+
+  {
+    closer_group group(_loop);
+    group.add_fd(a.reader_fd(), fd_slots{.readable = [&](int) { reads++; }},
+                 fd_events::read);
+    group.add_fd(b.reader_fd(), fd_slots{.readable = [&](int) { reads++; }},
+                 fd_events::read);
+    group.post(1s, [&] { timers++; });
+    group.post(2s, [&] { timers++; });
+    group.adopt(sig.connect([&] { signals++; }));
+    REQUIRE(group.fds() == 2);
+    REQUIRE(group.callbacks() == 2);
+    REQUIRE(work_to_do());
+  }
+  REQUIRE(!work_to_do());
+
+  REQUIRE(::write(a.writer_fd(), "x", 1) == 1);
+  fake_clock::advance(3s);
+  cycle();
+  sig();
+  REQUIRE(reads == 0);
+  REQUIRE(timers == 0);
+  REQUIRE(signals == 0);
+}
+
+TEST_CASE_METHOD(fake_clock_loop_test, "closer_group forgets fired callbacks",
+                 "[closer_group]") {
+  closer_group group(_loop);
+  int timers = 0;
+  group.post(1ms, [&] { timers++; });
+  group.post(1s, [&] { timers++; });
+
+  fake_clock::advance(2ms);
+  cycle();
+  REQUIRE(timers == 1);
+  REQUIRE(group.callbacks() == 1);
+
+  group.close();
+  fake_clock::advance(2s);
+  cycle();
+  REQUIRE(timers == 1);
+}
+
+TEST_CASE_METHOD(fake_clock_loop_test, "closer_group closed during dispatch",
+                 "[closer_group]") {
+  std::vector<std::unique_ptr<fd_pair>> pairs;
+  std::vector<std::unique_ptr<closer_group<fake_clock>>> groups;
+  int reads = 0;
+  for (int i = 0; i < 4; ++i) {
+    pairs.push_back(std::make_unique<fd_pair>());
+    groups.push_back(std::make_unique<closer_group<fake_clock>>(_loop));
+  }
+
+  // the first readable connection tears down all of them
+  for (int i = 0; i < 4; ++i) {
+    groups[i]->add_fd(pairs[i]->reader_fd(),
+                      fd_slots{.readable =
+                                   [&](int) {
+                                     reads++;
+                                     for (auto& g : groups) g->close();
+                                   }},
+                      fd_events::read);
+    REQUIRE(::write(pairs[i]->writer_fd(), "x", 1) == 1);
+  }
+
+  cycle();
+  REQUIRE(reads == 1);
+  cycle();
+  REQUIRE(!work_to_do());
+}
+
+TEST_CASE_METHOD(fake_clock_loop_test, "closer_group closed by a timer",
+                 "[closer_group]") {
+  fd_pair a;
+  int timers = 0;
+  int reads = 0;
+  closer_group victim(_loop);
+  victim.add_fd(a.reader_fd(), fd_slots{.readable = [&](int) { reads--; }},
+                fd_events::read);
+  victim.post(2ms, [&] { timers--; });
+
+  closer again;
+  closer_group killer(_loop);
+  killer.post(1ms, [&] {
+    timers++;
+    victim.close();
+    // the fd number is registered again before the cycle ends
+    again = _loop.add_fd(a.reader_fd(),
+                         fd_slots{.readable = [&](int) { reads++; }},
+                         fd_events::read);
+  });
+
+  // both timers are due, the victim's is skipped once closed
+  fake_clock::advance(2ms);
+  cycle();
+  REQUIRE(timers == 1);
+  REQUIRE(victim.callbacks() == 0);
+
+  REQUIRE(::write(a.writer_fd(), "x", 1) == 1);
+  cycle();
+  REQUIRE(reads == 1);
+}
+
+}  // namespace hula::test
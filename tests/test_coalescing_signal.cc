@@ -0,0 +1,131 @@
+#include "fakes.h"
+
+#include <hulaloop/coalescing_signal.h>
+
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace hula::test {
+
+TEST_CASE_METHOD(loop_test, "coalescing_signal delivers latest value once",
+                 "[coalescing_signal]") {
+  coalescing_signal<int> s(_loop);
+  std::vector<int> received;
+  auto c = s.connect([&](int v) { received.push_back(v); });
+
+  for (int i = 0; i < 1000; ++i) s(i);
+  REQUIRE(received.empty());
+  REQUIRE(s.dirty());
+
+  cycle();
+  REQUIRE(received == std::vector<int>{999});
+  REQUIRE(!s.dirty());
+
+  s(5);
+  cycle();
+  REQUIRE(received == std::vector<int>{999, 5});
+}
+
+TEST_CASE_METHOD(loop_test, "coalescing_signal flush", "[coalescing_signal]") {
+  coalescing_signal<std::string> s(_loop);
+  std::vector<std::string> received;
+  auto c = s.connect([&](const std::string& v) { received.push_back(v); });
+
+  s("a");
+  s("b");
+  s.flush();
+  REQUIRE(received == std::vector<std::string>{"b"});
+  REQUIRE(!s.dirty());
+}
+
+TEST_CASE_METHOD(loop_test, "coalescing_signal flushed by its slots",
+                 "[coalescing_signal]") {
+  coalescing_signal<int> s(_loop);
+  std::vector<int> received;
+  auto c = s.connect([&](int v) {
+    received.push_back(v);
+    if (v < 3) {
+      s(v + 1);
+      s.flush();
+    }
+  });
+
+  s(1);
+  s.flush();
+  // the value fired from the slot waits for the next cycle
+  REQUIRE(received == std::vector<int>{1});
+  REQUIRE(s.dirty());
+
+  cycle();
+  REQUIRE(received == std::vector<int>{1, 2});
+  cycle();
+  REQUIRE(received == std::vector<int>{1, 2, 3});
+  REQUIRE(!s.dirty());
+}
+
+TEST_CASE_METHOD(loop_test, "coalescing_signal destroyed while dirty",
+                 "[coalescing_signal]") {
+  int calls = 0;
+  {
+    coalescing_signal<int> s(_loop);
+    auto c = s.connect([&](int) { calls++; });
+    s(1);
+  }
+  cycle();
+  REQUIRE(calls == 0);
+}
+
+TEST_CASE_METHOD(loop_test, "keyed_coalescing_signal coalesces per key",
+                 "[coalescing_signal]") {
+  keyed_coalescing_signal<std::string, double> s(_loop);
+  std::vector<std::pair<std::string, double>> received;
+  auto c = s.connect([&](const std::string& k, double v) {
+    received.emplace_back(k, v);
+  });
+
+  s("ESZ4", 1.0);
+  s("NQZ4", 2.0);
+  s("ESZ4", 3.0);
+  s("NQZ4", 4.0);
+  s("ESZ4", 5.0);
+  REQUIRE(s.dirty() == 2);
+
+  cycle();
+  REQUIRE(received == std::vector<std::pair<std::string, double>>{
+                          {"ESZ4", 5.0}, {"NQZ4", 4.0}});
+
+  s("NQZ4", 6.0);
+  cycle();
+  REQUIRE(received.back() == std::pair<std::string, double>{"NQZ4", 6.0});
+  REQUIRE(received.size() == 3);
+}
+
+TEST_CASE_METHOD(loop_test, "keyed_coalescing_signal flushed by its slots",
+                 "[coalescing_signal]") {
+  keyed_coalescing_signal<std::string, int> s(_loop);
+  std::vector<std::pair<std::string, int>> received;
+  auto c = s.connect([&](const std::string& k, int v) {
+    received.emplace_back(k, v);
+    if (v < 3) {
+      s(k, v + 10);
+      s.flush();
+    }
+  });
+
+  s("a", 1);
+  s("b", 2);
+  s.flush();
+  // the keys fired from the slots wait for the next cycle
+  REQUIRE(received == std::vector<std::pair<std::string, int>>{{"a", 1},
+                                                               {"b", 2}});
+  REQUIRE(s.dirty() == 2);
+
+  cycle();
+  REQUIRE(received == std::vector<std::pair<std::string, int>>{
+                          {"a", 1}, {"b", 2}, {"a", 11}, {"b", 12}});
+  REQUIRE(s.dirty() == 0);
+}
+
+}  // namespace hula::test
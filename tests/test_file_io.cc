@@ -0,0 +1,139 @@
+#include "fakes.h"
+
+#include <hulaloop/file_io.h>
+
+#include <catch2/catch_test_macros.hpp>
+#include <cstdio>
+#include <string>
+
+namespace hula::test {
+
+namespace {
+struct temp_file {
+  std::FILE* f = std::tmpfile();
+
+  ~temp_file() { std::fclose(f); }
+
+  int fd() const { return fileno(f); }
+
+  void fill(const std::string& s) {
+    std::fwrite(s.data(), 1, s.size(), f);
+    std::fflush(f);
+  }
+};
+
+std::string make_content(size_t n) {
+  std::string s(n, '\0');
+  for (size_t i = 0; i < n; ++i) s[i] = static_cast<char>('a' + i % 26);
+  return s;
+}
+}  // namespace
+
+TEST_CASE_METHOD(loop_test, "file_io read at offset", "[file_io]") {
+  temp_file tmp;
+  tmp.fill("hello world");
+
+  file_io io(_loop);
+  std::byte buf[5];
+  file_result result{.error = -1};
+  auto c = io.read(tmp.fd(), 6, buf, [&](file_result r) { result = r; });
+  REQUIRE(io.pending() == 1);
+
+  for (int i = 0; i < 1000 && result.error == -1; ++i) cycle();
+  REQUIRE(result.error == 0);
+  REQUIRE(result.bytes == 5);
+  REQUIRE(std::string(reinterpret_cast<char*>(buf), 5) == "world");
+  REQUIRE(io.pending() == 0);
+}
+
+TEST_CASE_METHOD(loop_test, "file_io write then read", "[file_io]") {
+  temp_file tmp;
+  file_io io(_loop);
+
+  std::string msg = "async";
+  bool written = false;
+  auto wc = io.write(tmp.fd(), 0, std::as_bytes(std::span(msg)),
+                     [&](file_result r) {
+                       REQUIRE(r.bytes == msg.size());
+                       written = true;
+                     });
+  for (int i = 0; i < 1000 && !written; ++i) cycle();
+  REQUIRE(written);
+
+  char buf[16] = {};
+  REQUIRE(::pread(tmp.fd(), buf, sizeof(buf), 0) == 5);
+  REQUIRE(std::string(buf) == "async");
+}
+
+TEST_CASE_METHOD(loop_test, "file_io read error", "[file_io]") {
+  file_io io(_loop);
+  std::byte buf[4];
+  file_result result{.error = -1};
+  auto c = io.read(-1, 0, buf, [&](file_result r) { result = r; });
+
+  for (int i = 0; i < 1000 && result.error == -1; ++i) cycle();
+  REQUIRE(result.error == EBADF);
+}
+
+TEST_CASE_METHOD(loop_test, "file_io cancelled read", "[file_io]") {
+  temp_file tmp;
+  tmp.fill("data");
+
+  file_io io(_loop);
+  std::byte buf[4];
+  bool called = false;
+  auto c = io.read(tmp.fd(), 0, buf, [&](file_result) { called = true; });
+  c.close();
+  REQUIRE(io.pending() == 0);
+
+  for (int i = 0; i < 50; ++i) cycle();
+  REQUIRE(!called);
+}
+
+TEST_CASE_METHOD(loop_test, "file_io stream", "[file_io]") {
+  temp_file tmp;
+  auto content = make_content(100000);
+  tmp.fill(content);
+
+  file_io io(_loop, {.threads = 4});
+  std::string received;
+  size_t chunks = 0;
+  int done = -1;
+  auto c = io.read_stream(
+      tmp.fd(), 4096,
+      [&](std::span<const std::byte> chunk) {
+        chunks++;
+        received.append(reinterpret_cast<const char*>(chunk.data()),
+                        chunk.size());
+      },
+      [&](int err) { done = err; });
+
+  for (int i = 0; i < 10000 && done == -1; ++i) cycle();
+  REQUIRE(done == 0);
+  REQUIRE(chunks == (content.size() + 4095) / 4096);
+  REQUIRE(received == content);
+}
+
+TEST_CASE_METHOD(loop_test, "file_io stream cancelled from chunk slot",
+                 "[file_io]") {
+  temp_file tmp;
+  tmp.fill(make_content(10000));
+
+  file_io io(_loop);
+  size_t chunks = 0;
+  bool done = false;
+  closer c;
+  c = io.read_stream(
+      tmp.fd(), 1000,
+      [&](std::span<const std::byte>) {
+        chunks++;
+        c.close();
+      },
+      [&](int) { done = true; });
+
+  for (int i = 0; i < 200; ++i) cycle();
+  REQUIRE(chunks == 1);
+  REQUIRE(!done);
+}
+
+}  // namespace hula::test
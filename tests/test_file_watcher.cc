@@ -0,0 +1,177 @@
+#include "fakes.h"
+
+#include <hulaloop/file_watcher.h>
+
+#include <catch2/catch_test_macros.hpp>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+
+namespace hula::test {
+
+namespace {
+// a fresh directory, removed with its contents afterwards
+struct temp_dir {
+  std::string path;
+
+  temp_dir() {
+    char tmpl[] = "/tmp/hula_watch_XXXXXX";
+    path = ::mkdtemp(tmpl);
+  }
+
+  ~temp_dir() { std::filesystem::remove_all(path); }
+};
+
+void write_file(const std::string& path, const std::string& data,
+                int chunks = 1) {
+  int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  REQUIRE(fd >= 0);
+  for (int i = 0; i < chunks; ++i) {
+    REQUIRE(::write(fd, data.data(), data.size()) ==
+            static_cast<ssize_t>(data.size()));
+  }
+  ::close(fd);
+}
+
+struct recorder {
+  std::vector<file_change> changes;
+  closer c;
+
+  template <class Watcher>
+  explicit recorder(Watcher& w)
+      : c(w.connect([this](const file_change& ch) { changes.push_back(ch); })) {
+  }
+};
+}  // namespace
+
+TEST_CASE_METHOD(loop_test, "file_watcher coalesces writes until close",
+                 "[file_watcher]") {
+  temp_dir dir;
+  std::string path = dir.path + "/config";
+  write_file(path, "v1");
+
+  file_watcher w(_loop, {.quiet_period = 10s});
+  w.watch_file(path);
+  recorder r(w);
+
+  write_file(path, "some data\n", 100);
+  for (int i = 0; i < 100 && r.changes.empty(); ++i) cycle();
+
+  REQUIRE(r.changes.size() == 1);
+  REQUIRE(r.changes[0].path == path);
+  REQUIRE(r.changes[0].event == file_event::modified);
+}
+
+TEST_CASE_METHOD(loop_test, "file_watcher delivers after a quiet period",
+                 "[file_watcher]") {
+  temp_dir dir;
+  std::string path = dir.path + "/data";
+  write_file(path, "");
+
+  file_watcher w(_loop, {.quiet_period = 20ms});
+  w.watch_file(path);
+  std::vector<std::vector<file_change>> batches;
+  auto c = w.connect_batch([&](std::span<const file_change> changes) {
+    batches.emplace_back(changes.begin(), changes.end());
+  });
+
+  // modified but not closed
+  int fd = ::open(path.c_str(), O_WRONLY);
+  REQUIRE(::write(fd, "a", 1) == 1);
+  REQUIRE(::write(fd, "b", 1) == 1);
+  cycle();
+  REQUIRE(batches.empty());
+
+  for (int i = 0; i < 1000 && batches.empty(); ++i) cycle();
+  ::close(fd);
+  REQUIRE(batches.size() == 1);
+  REQUIRE(batches[0].size() == 1);
+  REQUIRE(batches[0][0].event == file_event::modified);
+}
+
+TEST_CASE_METHOD(loop_test, "file_watcher sees atomic replace",
+                 "[file_watcher]") {
+  temp_dir dir;
+  std::string path = dir.path + "/config";
+  write_file(path, "v1");
+
+  file_watcher w(_loop, {.quiet_period = 10s});
+  w.watch_file(path);
+  recorder r(w);
+
+  // an unrelated file in the same directory is ignored
+  std::string tmp = dir.path + "/config.tmp";
+  write_file(tmp, "v2");
+  REQUIRE(std::rename(tmp.c_str(), path.c_str()) == 0);
+  for (int i = 0; i < 100 && r.changes.empty(); ++i) cycle();
+
+  REQUIRE(r.changes.size() == 1);
+  REQUIRE(r.changes[0].path == path);
+  REQUIRE(r.changes[0].event == file_event::replaced);
+
+  // still watched after the replace
+  r.changes.clear();
+  write_file(path, "v3");
+  for (int i = 0; i < 100 && r.changes.empty(); ++i) cycle();
+  REQUIRE(r.changes.size() == 1);
+  REQUIRE(r.changes[0].event == file_event::modified);
+}
+
+TEST_CASE_METHOD(loop_test, "file_watcher watches directories recursively",
+                 "[file_watcher]") {
+  temp_dir dir;
+  std::filesystem::create_directories(dir.path + "/a/b");
+
+  file_watcher w(_loop, {.quiet_period = 10s});
+  w.watch_dir(dir.path, true);
+  REQUIRE(w.watches() == 3);
+  recorder r(w);
+
+  write_file(dir.path + "/a/b/deep", "x");
+  for (int i = 0; i < 100 && r.changes.empty(); ++i) cycle();
+  REQUIRE(r.changes.size() == 1);
+  REQUIRE(r.changes[0].path == dir.path + "/a/b/deep");
+  REQUIRE(r.changes[0].event == file_event::created);
+
+  // a new subdirectory is watched as well
+  r.changes.clear();
+  std::filesystem::create_directory(dir.path + "/c");
+  for (int i = 0; i < 100 && w.watches() < 4; ++i) cycle();
+  REQUIRE(w.watches() == 4);
+  write_file(dir.path + "/c/new", "x");
+  for (int i = 0; i < 100 && r.changes.empty(); ++i) cycle();
+  REQUIRE(r.changes.size() == 1);
+  REQUIRE(r.changes[0].path == dir.path + "/c/new");
+
+  w.unwatch(dir.path);
+  REQUIRE(w.watches() == 0);
+}
+
+TEST_CASE_METHOD(loop_test,
+                 "file_watcher ignores directories gone before their watch",
+                 "[file_watcher]") {
+  temp_dir dir;
+  file_watcher w(_loop, {.quiet_period = 10s});
+  w.watch_dir(dir.path, true);
+  recorder r(w);
+
+  // each directory is removed before the watcher reads its create event
+  for (int i = 0; i < 50; ++i) {
+    auto sub = dir.path + "/d" + std::to_string(i);
+    std::filesystem::create_directory(sub);
+    std::filesystem::remove(sub);
+  }
+  for (int i = 0; i < 10; ++i) REQUIRE_NOTHROW(cycle());
+  REQUIRE(w.watches() == 1);
+
+  write_file(dir.path + "/after", "x");
+  for (int i = 0; i < 100 && r.changes.empty(); ++i) cycle();
+  REQUIRE(r.changes.size() == 1);
+  REQUIRE(r.changes[0].path == dir.path + "/after");
+  REQUIRE(r.changes[0].event == file_event::created);
+}
+
+}  // namespace hula::test
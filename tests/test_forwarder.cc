@@ -0,0 +1,225 @@
+#include "fakes.h"
+
+#include <hulaloop/forwarder.h>
+
+#include <catch2/catch_test_macros.hpp>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+#include <sys/socket.h>
+
+namespace hula::test {
+
+namespace {
+// a connected pair of unix stream sockets
+struct socket_pair {
+  int fds[2] = {-1, -1};
+
+  socket_pair() {
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+      throw std::runtime_error("socketpair failed");
+    }
+  }
+
+  ~socket_pair() {
+    for (int fd : fds) ::close(fd);
+  }
+};
+
+std::string read_some(int fd) {
+  char buf[4096];
+  auto n = ::read(fd, buf, sizeof(buf));
+  return n > 0 ? std::string(buf, n) : std::string();
+}
+}  // namespace
+
+TEST_CASE_METHOD(loop_test, "forwarder splices both directions",
+                 "[forwarder]") {
+  socket_pair left;
+  socket_pair right;
+
+  int closed = -1;
+  forwarder f(_loop, left.fds[1], right.fds[0],
+              [&](int err) { closed = err; });
+  REQUIRE(f.a_to_b_transfer() == transfer::splice);
+  REQUIRE(f.b_to_a_transfer() == transfer::splice);
+
+  ::write(left.fds[0], "ping", 4);
+  cycle();
+  REQUIRE(read_some(right.fds[1]) == "ping");
+
+  ::write(right.fds[1], "pong", 4);
+  cycle();
+  REQUIRE(read_some(left.fds[0]) == "pong");
+
+  REQUIRE(f.a_to_b().bytes == 4);
+  REQUIRE(f.b_to_a().bytes == 4);
+  REQUIRE(f.total().syscalls >= 4);
+
+  // eof propagates per direction, closing once both are done
+  ::shutdown(left.fds[0], SHUT_WR);
+  cycle();
+  REQUIRE(::read(right.fds[1], nullptr, 0) == 0);
+  REQUIRE(closed == -1);
+
+  ::shutdown(right.fds[1], SHUT_WR);
+  cycle();
+  cycle();
+  REQUIRE(closed == 0);
+  REQUIRE(f.stopped());
+}
+
+TEST_CASE_METHOD(loop_test, "forwarder copy fallback", "[forwarder]") {
+  socket_pair left;
+  socket_pair right;
+
+  forwarder f(
+      _loop, left.fds[1], right.fds[0], [](int) {},
+      {.bidirectional = false, .force_copy = true});
+  REQUIRE(f.a_to_b_transfer() == transfer::copy);
+
+  ::write(left.fds[0], "hello", 5);
+  cycle();
+  REQUIRE(read_some(right.fds[1]) == "hello");
+  REQUIRE(f.a_to_b().bytes == 5);
+  REQUIRE(f.a_to_b().syscalls == 2);
+
+  // not forwarded the other way
+  ::write(right.fds[1], "back", 4);
+  cycle();
+  REQUIRE(f.b_to_a().bytes == 0);
+}
+
+TEST_CASE_METHOD(loop_test, "forwarder sendfile from file", "[forwarder]") {
+  std::FILE* tmp = std::tmpfile();
+  std::string content(100000, 'z');
+  std::fwrite(content.data(), 1, content.size(), tmp);
+  std::fflush(tmp);
+
+  socket_pair out;
+  ::fcntl(out.fds[1], F_SETFL, O_NONBLOCK);
+  int closed = -1;
+  forwarder f(
+      _loop, fileno(tmp), out.fds[0], [&](int err) { closed = err; },
+      {.bidirectional = false});
+  REQUIRE(f.a_to_b_transfer() == transfer::sendfile);
+
+  std::string received;
+  for (int i = 0; i < 100 && closed == -1; ++i) {
+    cycle();
+    std::string chunk;
+    while (!(chunk = read_some(out.fds[1])).empty()) received += chunk;
+  }
+  REQUIRE(closed == 0);
+  REQUIRE(received == content);
+  REQUIRE(f.a_to_b().bytes == content.size());
+
+  std::fclose(tmp);
+}
+
+TEST_CASE_METHOD(loop_test, "forwarder rejects two files", "[forwarder]") {
+  std::FILE* a = std::tmpfile();
+  std::FILE* b = std::tmpfile();
+  REQUIRE_THROWS_AS(forwarder(_loop, fileno(a), fileno(b), [](int) {}),
+                    std::invalid_argument);
+  std::fclose(a);
+  std::fclose(b);
+}
+
+TEST_CASE_METHOD(loop_test, "forwarder applies backpressure", "[forwarder]") {
+  socket_pair left;
+  socket_pair right;
+
+  forwarder f(
+      _loop, left.fds[1], right.fds[0], [](int) {}, {.bidirectional = false});
+
+  // nobody reads the right side, so eventually everything backs up
+  std::string chunk(64 * 1024, 'x');
+  ::fcntl(left.fds[0], F_SETFL, O_NONBLOCK);
+  size_t written = 0;
+  for (int i = 0; i < 200; ++i) {
+    auto n = ::write(left.fds[0], chunk.data(), chunk.size());
+    if (n > 0) written += n;
+    cycle();
+  }
+
+  auto syscalls = f.a_to_b().syscalls;
+  for (int i = 0; i < 50; ++i) cycle();
+  // no busy reading or writing while blocked
+  REQUIRE(f.a_to_b().syscalls == syscalls);
+
+  // drain the right side and everything flows again
+  size_t received = 0;
+  ::fcntl(right.fds[1], F_SETFL, O_NONBLOCK);
+  for (int i = 0; i < 1000 && received < written; ++i) {
+    char buf[64 * 1024];
+    auto n = ::read(right.fds[1], buf, sizeof(buf));
+    if (n > 0) received += n;
+    cycle();
+  }
+  REQUIRE(received == written);
+}
+
+TEST_CASE_METHOD(loop_test, "forwarder peer closing ends the direction",
+                 "[forwarder]") {
+  socket_pair left;
+  socket_pair right;
+
+  forwarder<>::options opts;
+  SECTION("splice") {}
+  SECTION("copy") { opts.force_copy = true; }
+
+  int closed = -1;
+  forwarder f(
+      _loop, left.fds[1], right.fds[0], [&](int err) { closed = err; }, opts);
+
+  // the write towards the closed peer fails with EPIPE, not SIGPIPE
+  ::write(left.fds[0], "lost", 4);
+  ::close(right.fds[1]);
+  right.fds[1] = -1;
+  for (int i = 0; i < 3; ++i) cycle();
+  REQUIRE(closed == 0);
+  REQUIRE(f.stopped());
+}
+
+TEST_CASE_METHOD(loop_test, "forwarder into a pipe without a reader",
+                 "[forwarder]") {
+  socket_pair left;
+  fd_pair p{};
+
+  forwarder<>::options opts{.bidirectional = false};
+  SECTION("splice") {}
+  SECTION("copy") { opts.force_copy = true; }
+
+  int closed = -1;
+  forwarder f(
+      _loop, left.fds[1], p.writer_fd(), [&](int err) { closed = err; },
+      opts);
+
+  p.reader_close();
+  ::write(left.fds[0], "lost", 4);
+  cycle();
+  cycle();
+  REQUIRE(closed == 0);
+}
+
+TEST_CASE_METHOD(loop_test, "forwarder hangup with nothing queued",
+                 "[forwarder]") {
+  socket_pair left;
+  socket_pair right;
+
+  int closed = -1;
+  forwarder f(
+      _loop, left.fds[1], right.fds[0], [&](int err) { closed = err; },
+      {.bidirectional = false});
+
+  ::close(right.fds[1]);
+  right.fds[1] = -1;
+  cycle();
+  cycle();
+  REQUIRE(closed == 0);
+  REQUIRE(f.stopped());
+}
+
+}  // namespace hula::test
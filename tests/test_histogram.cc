@@ -0,0 +1,57 @@
+#include <hulaloop/histogram.h>
+
+#include <catch2/catch_test_macros.hpp>
+
+namespace hula::test {
+
+TEST_CASE("histogram empty", "[histogram]") {
+  histogram h;
+  REQUIRE(h.count() == 0);
+  REQUIRE(h.percentile(0.99) == 0);
+  REQUIRE(h.min() == 0);
+  REQUIRE(h.max() == 0);
+}
+
+TEST_CASE("histogram percentiles", "[histogram]") {
+  histogram h;
+  for (int64_t v = 1; v <= 10000; ++v) h.record(v);
+
+  REQUIRE(h.count() == 10000);
+  REQUIRE(h.min() == 1);
+  REQUIRE(h.max() == 10000);
+  REQUIRE(h.mean() == 5000.5);
+
+  // within the bucket precision of about 6%
+  auto within = [](int64_t v, int64_t expected) {
+    return v >= expected && v <= expected + expected / 16 + 1;
+  };
+  REQUIRE(within(h.percentile(0.5), 5000));
+  REQUIRE(within(h.percentile(0.99), 9900));
+  REQUIRE(h.percentile(1.0) == 10000);
+  REQUIRE(h.percentile(0.0) == 1);
+}
+
+TEST_CASE("histogram small values are exact", "[histogram]") {
+  histogram h;
+  for (int i = 0; i < 10; ++i) h.record(3);
+  h.record(7);
+  REQUIRE(h.percentile(0.5) == 3);
+  REQUIRE(h.percentile(1.0) == 7);
+}
+
+TEST_CASE("histogram large values and merge", "[histogram]") {
+  histogram a, b;
+  a.record(1'000'000'000'000);
+  b.record(-5);  // clamped to 0
+  b.record(INT64_MAX);
+  a.merge(b);
+  REQUIRE(a.count() == 3);
+  REQUIRE(a.min() == 0);
+  REQUIRE(a.max() == INT64_MAX);
+  REQUIRE(a.percentile(1.0) == INT64_MAX);
+
+  a.reset();
+  REQUIRE(a.count() == 0);
+}
+
+}  // namespace hula::test
@@ -0,0 +1,130 @@
+#include "fakes.h"
+
+#include <hulaloop/idle_timeouts.h>
+
+#include <catch2/catch_test_macros.hpp>
+#include <vector>
+
+namespace hula::test {
+
+namespace {
+struct idle_test : fake_clock_loop_test {
+  std::vector<uint64_t> expired;
+
+  idle_timeouts<fake_clock> idle{
+      _loop, 1s,
+      [this](std::span<const uint64_t> keys) {
+        expired.insert(expired.end(), keys.begin(), keys.end());
+      },
+      {.granularity = 100ms}};
+
+  void run_for(fake_clock::duration d, fake_clock::duration step = 10ms) {
+    auto end = fake_clock::now() + d;
+    while (fake_clock::now() < end) {
+      cycle();
+      fake_clock::advance(step);
+    }
+  }
+};
+}  // namespace
+
+TEST_CASE_METHOD(idle_test, "idle_timeouts expires untouched entries",
+                 "[idle_timeouts]") {
+  idle.add(1);
+  idle.add(2);
+  REQUIRE(idle.size() == 2);
+
+  run_for(900ms);
+  REQUIRE(expired.empty());
+
+  run_for(300ms);
+  REQUIRE(expired == std::vector<uint64_t>{1, 2});
+  REQUIRE(idle.size() == 0);
+}
+
+TEST_CASE_METHOD(idle_test, "idle_timeouts touch defers expiry",
+                 "[idle_timeouts]") {
+  auto a = idle.add(1);
+  auto b = idle.add(2);
+
+  for (int i = 0; i < 5; ++i) {
+    run_for(500ms);
+    idle.touch(a);
+  }
+  REQUIRE(expired == std::vector<uint64_t>{2});
+  REQUIRE(idle.valid(a));
+  REQUIRE(!idle.valid(b));
+
+  run_for(1200ms);
+  REQUIRE(expired == std::vector<uint64_t>{2, 1});
+}
+
+TEST_CASE_METHOD(idle_test, "idle_timeouts remove", "[idle_timeouts]") {
+  auto a = idle.add(1);
+  idle.add(2);
+  idle.remove(a);
+  idle.remove(a);  // stale handle is ignored
+  REQUIRE(idle.size() == 1);
+
+  run_for(1200ms);
+  REQUIRE(expired == std::vector<uint64_t>{2});
+}
+
+TEST_CASE_METHOD(idle_test, "idle_timeouts ignores foreign handles",
+                 "[idle_timeouts]") {
+  idle.add(1);
+  const idle_timeouts<fake_clock>::handle unset{};
+  const idle_timeouts<fake_clock>::handle out_of_range{.index = 1000};
+  REQUIRE(!idle.valid(unset));
+  REQUIRE(!idle.valid(out_of_range));
+
+  run_for(500ms);
+  idle.touch(unset);
+  idle.touch(out_of_range);
+  idle.remove(unset);
+  idle.remove(out_of_range);
+  REQUIRE(idle.size() == 1);
+
+  // entry 1 was not touched through the default handle
+  run_for(700ms);
+  REQUIRE(expired == std::vector<uint64_t>{1});
+}
+
+TEST_CASE_METHOD(idle_test, "idle_timeouts reuses slots", "[idle_timeouts]") {
+  auto a = idle.add(1);
+  idle.remove(a);
+  auto b = idle.add(2);
+  REQUIRE(b.index == a.index);
+
+  // touching through the stale handle must not affect the new entry
+  run_for(600ms);
+  idle.touch(a);
+  run_for(600ms);
+  REQUIRE(expired == std::vector<uint64_t>{2});
+}
+
+TEST_CASE_METHOD(idle_test, "idle_timeouts stops sweeping when empty",
+                 "[idle_timeouts]") {
+  auto a = idle.add(1);
+  REQUIRE(work_to_do());
+  idle.remove(a);
+  REQUIRE(!work_to_do());
+
+  idle.add(2);
+  run_for(1200ms);
+  REQUIRE(expired == std::vector<uint64_t>{2});
+  REQUIRE(!work_to_do());
+}
+
+TEST_CASE_METHOD(idle_test, "idle_timeouts slot may add entries",
+                 "[idle_timeouts]") {
+  int rounds = 0;
+  idle_timeouts<fake_clock> self(_loop, 1s, [&](std::span<const uint64_t>) {
+    if (++rounds < 3) self.add(rounds);
+  });
+  self.add(0);
+  run_for(4s);
+  REQUIRE(rounds == 3);
+}
+
+}  // namespace hula::test
@@ -2,6 +2,7 @@
 
 #include <catch2/catch_test_macros.hpp>
 #include <cstring>
+#include <functional>
 
 namespace hula::test {
 
@@ -119,6 +120,169 @@ TEST_CASE_METHOD(loop_test, "loop schedule inside callback", "[loop]") {
   REQUIRE(val == 2);
 }
 
+TEST_CASE_METHOD(loop_test, "loop post once deduplicates", "[loop]") {
+  int val = 0;
+  auto id = _loop.post_once(7, [&] { val++; });
+  REQUIRE(_loop.post_once(7, [&] { val += 100; }) == id);
+  REQUIRE(_loop.pending(7));
+
+  cycle();
+  REQUIRE(val == 1);
+  REQUIRE(!_loop.pending(7));
+
+  // can be posted again once fired
+  _loop.post_once(7, [&] { val++; });
+  cycle();
+  REQUIRE(val == 2);
+}
+
+TEST_CASE_METHOD(loop_test, "loop post once from its own callback", "[loop]") {
+  int val = 0;
+  std::function<void()> again = [&] {
+    if (++val < 3) _loop.post_once(1, again);
+  };
+  _loop.post_once(1, again);
+
+  for (int i = 0; i < 5; ++i) cycle();
+  REQUIRE(val == 3);
+}
+
+TEST_CASE_METHOD(fake_clock_loop_test, "loop post once keeps earliest deadline",
+                 "[loop]") {
+  int val = 0;
+  auto id = _loop.post_once(1, 1s, [&] { val++; });
+  REQUIRE(_loop.post_once(1, 10ms, [&] { val += 100; }) == id);
+  REQUIRE(_loop.post_once(1, 2s, [&] { val += 100; }) == id);
+
+  fake_clock::advance(11ms);
+  cycle();
+  REQUIRE(val == 1);
+
+  fake_clock::advance(2s);
+  cycle();
+  REQUIRE(val == 1);
+}
+
+TEST_CASE_METHOD(loop_test, "loop post once after batch cancel", "[loop]") {
+  int fired = 0;
+  std::vector<uint64_t> ids;
+  // due first
+  auto id = _loop.post([&] {
+    // cancelled during the cycle, the key is free again straight away
+    _loop.cancel_callbacks(ids);
+    REQUIRE(!_loop.pending(7));
+    _loop.post_once(7, [&] { fired++; });
+    REQUIRE(_loop.pending(7));
+  });
+  ids.push_back(_loop.post_once(7, [&] { fired += 10; }));
+  REQUIRE(id > 0);
+
+  cycle();
+  cycle();
+  REQUIRE(fired == 1);
+  REQUIRE(!_loop.pending(7));
+}
+
+TEST_CASE_METHOD(loop_test, "loop schedule once cancelled", "[loop]") {
+  int val = 0;
+  auto c = _loop.schedule_once(3, [&] { val++; });
+  c.close();
+  REQUIRE(!_loop.pending(3));
+
+  _loop.post_once(3, [&] { val += 10; });
+  cycle();
+  REQUIRE(val == 10);
+}
+
+TEST_CASE_METHOD(loop_test, "loop idle task runs until done", "[loop]") {
+  int slices = 0;
+  auto id = _loop.post_idle([&](auto deadline) {
+    REQUIRE(deadline > std::chrono::steady_clock::now() - 1s);
+    return ++slices < 3 ? idle_result::more : idle_result::done;
+  });
+  REQUIRE(id > 0);
+
+  _loop.run();
+  REQUIRE(slices == 3);
+}
+
+TEST_CASE_METHOD(loop_test, "loop idle task waits while writable fds",
+                 "[loop]") {
+  fd_pair fds;
+  bool ran = false;
+  auto c = _loop.schedule_idle([&](auto) {
+    ran = true;
+    return idle_result::done;
+  });
+  auto fd_closer = _loop.add_fd(fds.writer_fd(), fd_slots{}, fd_events::write);
+
+  for (int i = 0; i < 10; ++i) cycle();
+  REQUIRE(!ran);
+
+  fd_closer.close();
+  for (int i = 0; i < 10 && !ran; ++i) cycle();
+  REQUIRE(ran);
+}
+
+TEST_CASE_METHOD(loop_test, "loop idle task runs when never quiet",
+                 "[loop]") {
+  fd_pair fds;
+  int slices = 0;
+  auto c = _loop.schedule_idle([&](auto) {
+    slices++;
+    return idle_result::more;
+  });
+  auto fd_closer = _loop.add_fd(fds.writer_fd(), fd_slots{}, fd_events::write);
+  _loop.set_poll_interval(0us);
+  _loop.set_idle_starvation_limit(5);
+
+  for (int i = 0; i < 4; ++i) cycle();
+  REQUIRE(slices == 0);
+  cycle();
+  REQUIRE(slices == 1);
+  for (int i = 0; i < 5; ++i) cycle();
+  REQUIRE(slices == 2);
+}
+
+TEST_CASE_METHOD(loop_test, "loop idle tasks stop with the loop", "[loop]") {
+  int first = 0;
+  int second = 0;
+  closer c1;
+  c1 = _loop.schedule_idle([&](auto) {
+    first++;
+    _loop.stop();
+    c1.close();
+    return idle_result::more;
+  });
+  auto c2 = _loop.schedule_idle([&](auto) {
+    second++;
+    return idle_result::done;
+  });
+
+  _loop.run();
+  REQUIRE(first == 1);
+  REQUIRE(second == 0);
+}
+
+TEST_CASE_METHOD(loop_test, "loop idle task cancelled", "[loop]") {
+  int slices = 0;
+  closer c;
+  c = _loop.schedule_idle([&](auto) {
+    if (++slices == 2) c.close();
+    return idle_result::more;
+  });
+  _loop.run();
+  REQUIRE(slices == 2);
+
+  auto id = _loop.post_idle([&](auto) {
+    slices++;
+    return idle_result::more;
+  });
+  _loop.cancel_callback(id);
+  _loop.run();
+  REQUIRE(slices == 2);
+}
+
 TEST_CASE_METHOD(loop_test, "loop signal handler", "[loop]") {
   int val = 1;
 
@@ -230,6 +394,24 @@ TEST_CASE_METHOD(fake_clock_loop_test, "loop fd removed during processing",
   REQUIRE(wval == 2);
 }
 
+TEST_CASE_METHOD(fake_clock_loop_test, "loop fd removed by its own slot",
+                 "[loop]") {
+  fd_pair p{};
+
+  int rval = 0;
+  p.reader_slots().readable = [&](int fd) {
+    rval++;
+    _loop.remove_fd(fd);
+  };
+  auto rc = _loop.add_fd(p.reader_fd(), p.reader_slots(), fd_events::read);
+
+  ::write(p.writer_fd(), "x", 1);
+  cycle();
+  REQUIRE(rval == 1);
+  // dropped from the poll set once the cycle is over
+  REQUIRE(!work_to_do());
+}
+
 TEST_CASE_METHOD(fake_clock_loop_test, "loop fd pending addition", "[loop]") {
   fd_pair p{};
 
@@ -301,4 +483,144 @@ TEST_CASE_METHOD(fake_clock_loop_test, "loop fd gets error events", "[loop]") {
   REQUIRE(err);
 }
 
+TEST_CASE_METHOD(fake_clock_loop_test, "loop batched fds delivered together",
+                 "[loop]") {
+  fd_pair p1{};
+  fd_pair p2{};
+  fd_pair p3{};
+
+  int calls = 0;
+  std::vector<ready_event> seen;
+  _loop.set_ready_slot([&](std::span<const ready_event> events) {
+    calls++;
+    seen.assign(events.begin(), events.end());
+  });
+
+  int tag1 = 1;
+  int tag2 = 2;
+  int tag3 = 3;
+  auto c1 = _loop.add_fd_batched(p1.reader_fd(), &tag1, fd_events::read);
+  auto c2 = _loop.add_fd_batched(p2.reader_fd(), &tag2, fd_events::read);
+  auto c3 = _loop.add_fd_batched(p3.reader_fd(), &tag3, fd_events::read);
+
+  cycle();
+  REQUIRE(calls == 0);
+
+  auto* msg = "hello";
+  auto msglen = strlen(msg);
+  ::write(p1.writer_fd(), msg, msglen);
+  ::write(p3.writer_fd(), msg, msglen);
+
+  cycle();
+  REQUIRE(calls == 1);
+  REQUIRE(seen.size() == 2);
+  REQUIRE(seen[0].fd == p1.reader_fd());
+  REQUIRE(seen[0].revents == POLLIN);
+  REQUIRE(seen[0].user_data == &tag1);
+  REQUIRE(seen[1].fd == p3.reader_fd());
+  REQUIRE(seen[1].user_data == &tag3);
+}
+
+TEST_CASE_METHOD(fake_clock_loop_test,
+                 "loop batched fds mixed with per-fd slots", "[loop]") {
+  fd_pair p1{};
+  fd_pair p2{};
+
+  int batched = 0;
+  int readable = 0;
+  _loop.set_ready_slot(
+      [&](std::span<const ready_event> events) { batched += events.size(); });
+  p2.reader_slots().readable = [&](int) { readable++; };
+
+  auto c1 = _loop.add_fd_batched(p1.reader_fd(), nullptr, fd_events::read);
+  auto c2 = _loop.add_fd(p2.reader_fd(), p2.reader_slots(), fd_events::read);
+
+  auto* msg = "hello";
+  auto msglen = strlen(msg);
+  ::write(p1.writer_fd(), msg, msglen);
+  ::write(p2.writer_fd(), msg, msglen);
+
+  cycle();
+  REQUIRE(batched == 1);
+  REQUIRE(readable == 1);
+
+  c1.close();
+  cycle();
+  REQUIRE(batched == 1);
+  REQUIRE(readable == 2);
+}
+
+TEST_CASE_METHOD(fake_clock_loop_test,
+                 "loop batched fds removed by a per-fd slot", "[loop]") {
+  fd_pair p1{};
+  fd_pair p2{};
+  fd_pair p3{};
+  fd_pair p4{};
+
+  std::vector<ready_event> seen;
+  _loop.set_ready_slot([&](std::span<const ready_event> events) {
+    seen.assign(events.begin(), events.end());
+  });
+  int tag1 = 1, tag3 = 3, tag4 = 4;
+  auto c1 = _loop.add_fd_batched(p1.reader_fd(), &tag1, fd_events::read);
+  auto c3 = _loop.add_fd_batched(p3.reader_fd(), &tag3, fd_events::read);
+  auto c4 = _loop.add_fd_batched(p4.reader_fd(), &tag4, fd_events::read);
+  // dispatched after the batched fds were collected
+  p2.reader_slots().readable = [&](int) {
+    c1.close();
+    int fds[] = {p3.reader_fd()};
+    _loop.remove_fds(fds);
+  };
+  auto c2 = _loop.add_fd(p2.reader_fd(), p2.reader_slots(), fd_events::read);
+
+  auto* msg = "hello";
+  for (auto* p : {&p1, &p2, &p3, &p4}) {
+    ::write(p->writer_fd(), msg, strlen(msg));
+  }
+
+  cycle();
+  REQUIRE(seen.size() == 1);
+  REQUIRE(seen[0].fd == p4.reader_fd());
+  REQUIRE(seen[0].user_data == &tag4);
+}
+
+TEST_CASE_METHOD(fake_clock_loop_test, "loop batched fd removed in ready slot",
+                 "[loop]") {
+  fd_pair p{};
+
+  int batched = 0;
+  closer c;
+  _loop.set_ready_slot([&](std::span<const ready_event> events) {
+    batched += events.size();
+    c.close();
+  });
+  c = _loop.add_fd_batched(p.reader_fd(), nullptr, fd_events::read);
+
+  auto* msg = "hello";
+  auto msglen = strlen(msg);
+  ::write(p.writer_fd(), msg, msglen);
+
+  cycle();
+  REQUIRE(batched == 1);
+
+  cycle();
+  REQUIRE(batched == 1);
+}
+
+TEST_CASE_METHOD(fake_clock_loop_test, "loop cached cycle time", "[loop]") {
+  std::vector<fake_clock::time_point> seen;
+  auto c = _loop.schedule(1ms, [&] { seen.push_back(_loop.cached_now()); });
+
+  fake_clock::advance(1ms);
+  cycle();
+  REQUIRE(seen == std::vector{fake_clock::now()});
+
+  // unchanged until the next cycle
+  fake_clock::advance(1ms);
+  REQUIRE(_loop.cached_now() == seen[0]);
+
+  auto wall = _loop.cached_wall_time();
+  REQUIRE(_loop.cached_wall_time() == wall);
+}
+
 }  // namespace hula::test
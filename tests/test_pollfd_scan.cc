@@ -0,0 +1,53 @@
+#include <hulaloop/pollfd_scan.h>
+
+#include <catch2/catch_test_macros.hpp>
+#include <random>
+#include <vector>
+
+namespace hula::test {
+
+namespace {
+std::vector<size_t> scan_all(detail::next_ready_fn next_ready,
+                             const std::vector<struct pollfd>& fds) {
+  std::vector<size_t> ready;
+  for (size_t i = next_ready(fds.data(), fds.size(), 0); i < fds.size();
+       i = next_ready(fds.data(), fds.size(), i + 1)) {
+    ready.push_back(i);
+  }
+  return ready;
+}
+}  // namespace
+
+TEST_CASE("pollfd scan finds ready entries", "[pollfd_scan]") {
+  std::vector<detail::next_ready_fn> impls{detail::pollfd_scan.next_ready};
+#if defined(_HULA_X86_SIMD)
+  impls.push_back(detail::next_ready_sse2);
+  if (__builtin_cpu_supports("avx2")) impls.push_back(detail::next_ready_avx2);
+#endif
+
+  std::mt19937 rng(42);
+  for (size_t n : {0, 1, 2, 3, 5, 8, 17, 64, 1001}) {
+    for (int density : {0, 1, 10, 100}) {
+      std::vector<struct pollfd> fds(n);
+      for (size_t i = 0; i < n; ++i) {
+        fds[i].fd = static_cast<int>(i);
+        fds[i].events = POLLIN;
+        if (density && static_cast<int>(rng() % 100) < density) {
+          fds[i].revents = (rng() % 2) ? POLLIN : POLLHUP;
+        }
+      }
+
+      auto expected = scan_all(detail::next_ready_scalar, fds);
+      for (auto impl : impls) REQUIRE(scan_all(impl, fds) == expected);
+    }
+  }
+}
+
+TEST_CASE("pollfd scan ignores fd and events", "[pollfd_scan]") {
+  std::vector<struct pollfd> fds(8, pollfd{.fd = -1, .events = -1});
+  fds[5].revents = POLLOUT;
+  REQUIRE(detail::pollfd_scan.next_ready(fds.data(), fds.size(), 0) == 5);
+  REQUIRE(detail::pollfd_scan.next_ready(fds.data(), fds.size(), 6) == 8);
+}
+
+}  // namespace hula::test
@@ -0,0 +1,137 @@
+#include "fakes.h"
+
+#include <hulaloop/process.h>
+
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace hula::test {
+
+namespace {
+std::string as_string(std::span<const std::byte> b) {
+  return std::string(reinterpret_cast<const char*>(b.data()), b.size());
+}
+
+std::span<const std::byte> as_bytes(const std::string& s) {
+  return std::as_bytes(std::span(s.data(), s.size()));
+}
+
+// bounded by time rather than cycles, children are slow on a loaded machine
+template <class F>
+void cycle_until(loop_test& t, F done) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (!done() && std::chrono::steady_clock::now() < deadline) t.cycle();
+}
+}  // namespace
+
+TEST_CASE_METHOD(loop_test, "process streams output and reports the exit",
+                 "[process]") {
+  std::string out, err;
+  std::optional<process_exit> exit;
+  process p(_loop, {
+                       .out = [&](auto b) { out += as_string(b); },
+                       .err = [&](auto b) { err += as_string(b); },
+                       .exit = [&](const process_exit& e) { exit = e; },
+                   });
+  p.spawn({"sh", "-c", "echo hello; echo oops >&2; exit 3"});
+  REQUIRE(p.pid() > 0);
+  REQUIRE(p.running());
+
+  cycle_until(*this, [&] { return exit.has_value(); });
+  REQUIRE(exit);
+  REQUIRE(exit->code == 3);
+  REQUIRE(exit->signal == 0);
+  REQUIRE(out == "hello\n");
+  REQUIRE(err == "oops\n");
+  REQUIRE(!p.running());
+}
+
+TEST_CASE_METHOD(loop_test, "process stdin", "[process]") {
+  std::string out;
+  bool exited = false;
+  process p(_loop, {
+                       .out = [&](auto b) { out += as_string(b); },
+                       .exit = [&](const process_exit&) { exited = true; },
+                   },
+            {.err = stdio::null});
+  p.spawn({"cat"});
+
+  // larger than a pipe buffer, so part of it is queued
+  std::string input(256 * 1024, 'x');
+  REQUIRE(p.write(as_bytes(input)));
+  p.close_stdin();
+  REQUIRE(!p.write(as_bytes("late")));
+
+  cycle_until(*this, [&] { return exited; });
+  REQUIRE(exited);
+  REQUIRE(out == input);
+}
+
+TEST_CASE_METHOD(loop_test, "process stdin closed by the child",
+                 "[process]") {
+  bool exited = false;
+  process p(_loop, {.exit = [&](const process_exit&) { exited = true; }},
+            {.out = stdio::null, .err = stdio::null});
+  p.spawn({"sh", "-c", "exec 0<&-; sleep 1"});
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+  // fails with EPIPE instead of SIGPIPE killing the test
+  REQUIRE(p.write(as_bytes("hello")));
+  REQUIRE(!p.write(as_bytes("again")));
+  REQUIRE(p.running());
+  REQUIRE(p.kill(SIGKILL));
+  cycle_until(*this, [&] { return exited; });
+  REQUIRE(exited);
+}
+
+TEST_CASE_METHOD(loop_test, "process reaped elsewhere reports the exit",
+                 "[process]") {
+  // children of a process ignoring SIGCHLD are reaped by the kernel
+  struct sigaction ignore {};
+  ignore.sa_handler = SIG_IGN;
+  struct sigaction old {};
+  REQUIRE(::sigaction(SIGCHLD, &ignore, &old) == 0);
+  struct restore {
+    struct sigaction& old;
+    ~restore() { ::sigaction(SIGCHLD, &old, nullptr); }
+  } restore{old};
+
+  std::optional<process_exit> exit;
+  process p(_loop, {.exit = [&](const process_exit& e) { exit = e; }},
+            {.in = stdio::null, .out = stdio::null, .err = stdio::null});
+  p.spawn({"true"});
+
+  cycle_until(*this, [&] { return exit.has_value(); });
+  REQUIRE(exit);
+  REQUIRE(exit->code == -1);
+  REQUIRE(exit->signal == 0);
+  REQUIRE(!p.running());
+}
+
+TEST_CASE_METHOD(loop_test, "process kill", "[process]") {
+  std::optional<process_exit> exit;
+  process p(_loop, {.exit = [&](const process_exit& e) { exit = e; }},
+            {.in = stdio::null, .out = stdio::null, .err = stdio::null});
+  p.spawn({"sleep", "10"});
+  REQUIRE(p.kill(SIGTERM));
+
+  cycle_until(*this, [&] { return exit.has_value(); });
+  REQUIRE(exit);
+  REQUIRE(exit->code == -1);
+  REQUIRE(exit->signal == SIGTERM);
+  REQUIRE(p.exit_status());
+  REQUIRE(!p.kill());
+}
+
+TEST_CASE_METHOD(loop_test, "process spawn failure throws", "[process]") {
+  process p(_loop, {});
+  REQUIRE_THROWS_AS(p.spawn({"/nonexistent/hula-test-binary"}),
+                    std::runtime_error);
+  REQUIRE(p.pid() == -1);
+}
+
+}  // namespace hula::test
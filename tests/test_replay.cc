@@ -0,0 +1,152 @@
+#include "fakes.h"
+
+#include <hulaloop/replay.h>
+
+#include <catch2/catch_test_macros.hpp>
+#include <cstring>
+#include <sstream>
+
+namespace hula::test {
+
+TEST_CASE("replay varint round trip", "[replay]") {
+  std::stringstream ss;
+  for (uint64_t v : {0ull, 1ull, 127ull, 128ull, 300ull, ~0ull}) {
+    replay::write_varint(ss, v);
+  }
+  for (uint64_t v : {0ull, 1ull, 127ull, 128ull, 300ull, ~0ull}) {
+    REQUIRE(replay::read_varint(ss) == v);
+  }
+}
+
+TEST_CASE("replay rejects bad recordings", "[replay]") {
+  std::stringstream bad("not a recording");
+  REQUIRE_THROWS(replay::read(bad));
+
+  std::stringstream truncated;
+  truncated.write(replay::k_magic, sizeof(replay::k_magic));
+  truncated.put(static_cast<char>(replay::record_type::timer));
+  REQUIRE_THROWS(replay::read(truncated));
+}
+
+TEST_CASE("replay record then replay", "[replay]") {
+  fake_clock::reset();
+  std::stringstream recording;
+
+  fd_pair p{};
+  auto* msg = "hello";
+  auto msglen = strlen(msg);
+
+  std::vector<fake_clock::time_point> live_reads;
+  std::vector<fake_clock::time_point> live_timers;
+  int live_signals = 0;
+  {
+    loop<fake_clock> l;
+    recording_backend rec;
+    rec.record_to(recording);
+    l.set_backend(&rec);
+
+    char buf[16];
+    p.reader_slots().readable = [&](int fd) {
+      ::read(fd, buf, sizeof(buf));
+      live_reads.push_back(fake_clock::now());
+    };
+    auto c = l.add_fd(p.reader_fd(), p.reader_slots(), fd_events::read);
+    auto t = l.schedule(5ms, [&] { live_timers.push_back(fake_clock::now()); });
+    auto s = l.connect_to_unix_signal(unix::sig::sigusr2,
+                                      [&] { live_signals++; });
+
+    ::write(p.writer_fd(), msg, msglen);
+    l.run_once();
+
+    fake_clock::advance(3ms);
+    l.run_once();  // nothing happens
+
+    fake_clock::advance(3ms);
+    ::write(p.writer_fd(), msg, msglen);
+    l.queue_unix_signal(unix::sig::sigusr2);
+    l.run_once();
+  }
+  REQUIRE(live_reads.size() == 2);
+  REQUIRE(live_timers.size() == 1);
+  REQUIRE(live_signals == 1);
+
+  fake_clock::advance(1h);
+  const auto replay_start = fake_clock::now();
+
+  replayer<fake_clock> r(recording);
+  REQUIRE(r.records().size() == 4);  // 2 polls, 1 timer, 1 signal
+
+  std::vector<fake_clock::duration> replay_reads;
+  std::vector<fake_clock::duration> replay_timers;
+  int replay_signals = 0;
+
+  loop<fake_clock> l;
+  fd_slots slots{
+      .readable = [&](int) {
+        replay_reads.push_back(fake_clock::now() - replay_start);
+      },
+  };
+  // the descriptor is never polled, any number will do
+  auto c = l.add_fd(p.reader_fd(), slots, fd_events::read);
+  auto t = l.schedule(
+      5ms, [&] { replay_timers.push_back(fake_clock::now() - replay_start); });
+  auto s =
+      l.connect_to_unix_signal(unix::sig::sigusr2, [&] { replay_signals++; });
+
+  REQUIRE(r.run(l) == 2);
+  REQUIRE(replay_reads.size() == 2);
+  REQUIRE(replay_reads[0] == live_reads[0] - live_reads[0]);
+  REQUIRE(replay_reads[1] == live_reads[1] - live_reads[0]);
+  REQUIRE(replay_timers.size() == 1);
+  REQUIRE(replay_timers[0] == live_timers[0] - live_reads[0]);
+  REQUIRE(r.timers_fired() == 1);
+  REQUIRE(replay_signals == 1);
+}
+
+TEST_CASE("replay rejects timers which diverge from the recording",
+          "[replay]") {
+  fake_clock::reset();
+  std::stringstream recording;
+  {
+    loop<fake_clock> l;
+    recording_backend rec;
+    rec.record_to(recording);
+    l.set_backend(&rec);
+    auto a = l.schedule(1ms, [] {});
+    auto b = l.schedule(2ms, [] {});
+    fake_clock::advance(1ms);
+    l.run_once();
+    fake_clock::advance(1ms);
+    l.run_once();
+  }
+
+  // the recording starts with the first timer firing
+  SECTION("same timers replay") {
+    replayer<fake_clock> r(recording);
+    loop<fake_clock> l;
+    auto a = l.schedule(1ms, [] {});
+    auto b = l.schedule(2ms, [] {});
+    fake_clock::advance(1ms);
+    REQUIRE(r.run(l) == 2);
+    REQUIRE(r.timers_fired() == 2);
+  }
+
+  SECTION("reordered timers") {
+    replayer<fake_clock> r(recording);
+    loop<fake_clock> l;
+    auto a = l.schedule(2ms, [] {});
+    auto b = l.schedule(1ms, [] {});
+    fake_clock::advance(1ms);
+    REQUIRE_THROWS(r.run(l));
+  }
+
+  SECTION("missing timer") {
+    replayer<fake_clock> r(recording);
+    loop<fake_clock> l;
+    auto a = l.schedule(1ms, [] {});
+    fake_clock::advance(1ms);
+    REQUIRE_THROWS(r.run(l));
+  }
+}
+
+}  // namespace hula::test
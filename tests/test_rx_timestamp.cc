@@ -0,0 +1,52 @@
+#include "fakes.h"
+
+#include <hulaloop/acceptor.h>
+#include <hulaloop/rx_timestamp.h>
+
+#include <catch2/catch_test_macros.hpp>
+
+namespace hula::test {
+
+TEST_CASE_METHOD(loop_test, "rx timestamps on a tcp connection",
+                 "[rx_timestamp]") {
+  int server_fd = -1;
+  acceptor acc(_loop, [&](std::span<const accepted_connection> conns) {
+    server_fd = conns[0].fd;
+  });
+  acc.listen("127.0.0.1", 0);
+
+  int client = loopback_connect(acc.port());
+  for (int i = 0; i < 100 && server_fd < 0; ++i) cycle();
+  REQUIRE(server_fd >= 0);
+  REQUIRE(net::enable_rx_timestamps(server_fd));
+
+  auto before = std::chrono::system_clock::now();
+  REQUIRE(::write(client, "hello", 5) == 5);
+
+  std::optional<net::timestamped_read> read;
+  auto c = _loop.add_fd(server_fd,
+                        fd_slots{.readable =
+                                     [&](int fd) {
+                                       std::byte buf[16];
+                                       read = net::recv_timestamped(fd, buf);
+                                       if (read->time) {
+                                         _loop.record_rx_delay(
+                                             net::rx_delay(*read->time));
+                                       }
+                                     }},
+                        fd_events::read);
+  for (int i = 0; i < 100 && !read; ++i) cycle();
+
+  REQUIRE(read);
+  REQUIRE(read->bytes == 5);
+  REQUIRE(read->time);
+  REQUIRE(*read->time >= before - 1s);
+  REQUIRE(_loop.rx_delay().count() == 1);
+  REQUIRE(_loop.rx_delay().max() >= 0);
+
+  c.close();
+  ::close(client);
+  ::close(server_fd);
+}
+
+}  // namespace hula::test
@@ -0,0 +1,183 @@
+#include "fakes.h"
+
+#include <hulaloop/shm_ring.h>
+
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace hula::test {
+
+namespace {
+std::span<const std::byte> as_bytes(const std::string& s) {
+  return std::as_bytes(std::span(s.data(), s.size()));
+}
+
+std::string as_string(std::span<const std::byte> b) {
+  return std::string(reinterpret_cast<const char*>(b.data()), b.size());
+}
+
+// the producer's view of the ring, as another process would get it
+shm_ring share(const shm_ring& ring) {
+  int sv[2];
+  REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == 0);
+  int fds[] = {ring.memfd(), ring.eventfd()};
+  REQUIRE(send_fds(sv[0], fds));
+  int received[2] = {-1, -1};
+  REQUIRE(recv_fds(sv[1], received) == 2);
+  ::close(sv[0]);
+  ::close(sv[1]);
+  return shm_ring::attach(received[0], received[1]);
+}
+}  // namespace
+
+TEST_CASE_METHOD(loop_test, "shm_ring messages delivered on the loop",
+                 "[shm_ring]") {
+  auto ring = shm_ring::create(4096);
+  auto producer = share(ring);
+
+  std::vector<std::string> received;
+  shm_ring_consumer consumer(_loop, ring, [&](std::span<const std::byte> m) {
+    received.push_back(as_string(m));
+  });
+
+  REQUIRE(producer.try_write(as_bytes("hello")));
+  REQUIRE(producer.try_write(as_bytes("")));
+  REQUIRE(producer.try_write(as_bytes("world")));
+
+  for (int i = 0; i < 100 && received.size() < 3; ++i) cycle();
+  REQUIRE(received == std::vector<std::string>{"hello", "", "world"});
+  REQUIRE(ring.empty());
+}
+
+TEST_CASE("shm_ring wraps and fills", "[shm_ring]") {
+  auto ring = shm_ring::create(4096);
+  REQUIRE(ring.capacity() == 4096);
+  std::string msg(1000, 'x');
+
+  // fill, then drain and refill repeatedly so records wrap around the end
+  int written = 0, read = 0;
+  auto check = [&](std::span<const std::byte> m) {
+    REQUIRE(as_string(m) == msg + std::to_string(read));
+    read++;
+  };
+  for (int round = 0; round < 50; ++round) {
+    while (ring.try_write(as_bytes(msg + std::to_string(written)))) written++;
+    REQUIRE(written - read >= 3);
+    REQUIRE(ring.read(check, 2) == 2);
+  }
+  ring.read(check);
+  REQUIRE(read == written);
+  REQUIRE(ring.empty());
+  REQUIRE_THROWS(ring.try_write(as_bytes(std::string(4096, 'x'))));
+}
+
+TEST_CASE("shm_ring attach checks the capacity", "[shm_ring]") {
+  auto ring = shm_ring::create(8192);
+  // a memfd too small for the capacity in its header
+  int memfd = ::dup(ring.memfd());
+  int efd = ::dup(ring.eventfd());
+  REQUIRE(::ftruncate(memfd, 4096 + 1024) == 0);
+  REQUIRE_THROWS(shm_ring::attach(memfd, efd));
+}
+
+TEST_CASE("shm_ring rejects corrupt records", "[shm_ring]") {
+  auto ring = shm_ring::create(4096);
+  const std::string msg = "corrupt me";
+  REQUIRE(ring.try_write(as_bytes(msg)));
+
+  // find the record's length just in front of the message and overwrite it
+  struct stat st{};
+  REQUIRE(::fstat(ring.memfd(), &st) == 0);
+  std::vector<char> contents(st.st_size);
+  REQUIRE(::pread(ring.memfd(), contents.data(), contents.size(), 0) ==
+          st.st_size);
+  auto at = std::string_view(contents.data(), contents.size()).find(msg);
+  REQUIRE(at != std::string_view::npos);
+  uint32_t len = 100000;
+  REQUIRE(::pwrite(ring.memfd(), &len, sizeof(len), at - sizeof(len)) ==
+          sizeof(len));
+
+  REQUIRE_THROWS(ring.read([](std::span<const std::byte>) {}));
+}
+
+TEST_CASE("shm_ring notifies on the empty edge only", "[shm_ring]") {
+  auto ring = shm_ring::create(4096);
+  auto pending = [&] {
+    uint64_t count = 0;
+    return ::read(ring.eventfd(), &count, sizeof(count)) == 8 ? count : 0;
+  };
+
+  REQUIRE(ring.try_write(as_bytes("a")));
+  REQUIRE(ring.try_write(as_bytes("b")));
+  REQUIRE(pending() == 1);
+
+  ring.read([](std::span<const std::byte>) {});
+  REQUIRE(ring.try_write(as_bytes("c")));
+  REQUIRE(pending() == 1);
+
+  ring.read([](std::span<const std::byte>) {});
+  ring.set_busy_poll(true);
+  REQUIRE(ring.try_write(as_bytes("d")));
+  REQUIRE(pending() == 0);
+}
+
+TEST_CASE_METHOD(loop_test, "shm_ring busy poll consumer", "[shm_ring]") {
+  auto ring = shm_ring::create(1 << 16);
+  auto producer = share(ring);
+
+  constexpr int k_messages = 20000;
+  int received = 0;
+  bool in_order = true;
+  shm_ring_consumer consumer(
+      _loop, ring,
+      [&](std::span<const std::byte> m) {
+        in_order &= as_string(m) == std::to_string(received);
+        received++;
+      },
+      {.busy_poll = true});
+
+  std::thread t([&] {
+    for (int i = 0; i < k_messages; ++i) {
+      while (!producer.try_write(as_bytes(std::to_string(i)))) {
+      }
+    }
+  });
+  for (int i = 0; i < 10'000'000 && received < k_messages; ++i) cycle();
+  t.join();
+
+  REQUIRE(received == k_messages);
+  REQUIRE(in_order);
+  uint64_t count = 0;
+  REQUIRE(::read(ring.eventfd(), &count, sizeof(count)) < 0);
+}
+
+TEST_CASE_METHOD(loop_test, "shm_ring cross thread with notifications",
+                 "[shm_ring]") {
+  auto ring = shm_ring::create(4096);
+  auto producer = share(ring);
+
+  constexpr int k_messages = 20000;
+  int received = 0;
+  bool in_order = true;
+  shm_ring_consumer consumer(_loop, ring, [&](std::span<const std::byte> m) {
+    in_order &= as_string(m) == std::to_string(received);
+    received++;
+  });
+
+  std::thread t([&] {
+    for (int i = 0; i < k_messages; ++i) {
+      while (!producer.try_write(as_bytes(std::to_string(i)))) {
+      }
+    }
+  });
+  for (int i = 0; i < 10'000'000 && received < k_messages; ++i) cycle();
+  t.join();
+
+  REQUIRE(received == k_messages);
+  REQUIRE(in_order);
+}
+
+}  // namespace hula::test
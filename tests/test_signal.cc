@@ -1,6 +1,9 @@
 #include <hulaloop/signal.h>
 
 #include <catch2/catch_test_macros.hpp>
+#include <string>
+#include <type_traits>
+#include <vector>
 
 namespace hula::test {
 
@@ -87,4 +90,164 @@ TEST_CASE("signal by ref signal", "[signal]") {
   REQUIRE(str == "blah");
 }
 
+namespace {
+struct counted {
+  static inline int copies = 0;
+  static inline int moves = 0;
+
+  counted() = default;
+  counted(const counted&) { copies++; }
+  counted(counted&&) noexcept { moves++; }
+
+  static void reset() { copies = moves = 0; }
+};
+}  // namespace
+
+TEST_CASE("signal variadic signal", "[signal]") {
+  int sum = 0;
+  std::string name;
+  signal<int, int, std::string> s;
+
+  auto c = s.connect([&](int a, int b, const std::string& n) {
+    sum = a + b;
+    name = n;
+  });
+
+  s(1, 2, "three");
+  REQUIRE(sum == 3);
+  REQUIRE(name == "three");
+}
+
+TEST_CASE("signal tag only distinguishes the type", "[signal]") {
+  using price_signal = signal<int, tag<struct price_tag>>;
+  static_assert(!std::is_same_v<price_signal, signal<int>>);
+  static_assert(std::is_same_v<price_signal::slot_type,
+                               signal<int>::slot_type>);
+
+  int seen = 0;
+  price_signal s;
+  slot<int, struct price_tag> on_price = [&](int v) { seen = v; };
+  auto c = s.connect(on_price);
+  s(42);
+  REQUIRE(seen == 42);
+
+  int fired = 0;
+  signal<void, tag<struct tick_tag>> tick;
+  auto c2 = tick.connect([&] { ++fired; });
+  tick();
+  REQUIRE(fired == 1);
+}
+
+TEST_CASE("signal delivers by const ref without copies", "[signal]") {
+  signal<counted> s;
+  const counted* seen[3] = {};
+  std::vector<closer> closers;
+  for (auto& p : seen) {
+    closers.push_back(s.connect([&p](const counted& c) { p = &c; }));
+  }
+
+  counted arg;
+  counted::reset();
+  s(arg);
+  REQUIRE(counted::copies == 0);
+  REQUIRE(counted::moves == 0);
+  for (auto* p : seen) REQUIRE(p == &arg);
+}
+
+TEST_CASE("signal by value copies all but the last slot", "[signal]") {
+  signal<by_value<counted>> s;
+  int calls = 0;
+  std::vector<closer> closers;
+  for (int i = 0; i < 3; ++i) {
+    closers.push_back(s.connect([&](counted) { calls++; }));
+  }
+
+  counted::reset();
+  s(counted{});
+  REQUIRE(calls == 3);
+  // one copy into each of the first two slots, the last is moved into
+  REQUIRE(counted::copies == 2);
+}
+
+TEST_CASE("signal by value moves into a single slot", "[signal]") {
+  signal<by_value<std::string>> s;
+  std::string received;
+  auto c = s.connect([&](std::string str) { received = std::move(str); });
+
+  std::string long_str(100, 'x');
+  const auto* data = long_str.data();
+  s(std::move(long_str));
+  REQUIRE(received.data() == data);
+}
+
+TEST_CASE("signal fire batch to item slots", "[signal]") {
+  signal<int> s;
+  std::vector<int> a, b;
+  auto ca = s.connect([&](int v) { a.push_back(v); });
+  auto cb = s.connect([&](int v) { b.push_back(v); });
+
+  std::vector<int> items{1, 2, 3};
+  s.fire_batch(items);
+  REQUIRE(a == items);
+  REQUIRE(b == items);
+}
+
+TEST_CASE("signal fire batch orders like separate fires", "[signal]") {
+  signal<int> s;
+  std::vector<std::string> calls;
+  auto ca = s.connect([&](int v) { calls.push_back("a" + std::to_string(v)); });
+  auto cbatch = s.connect_batch([&](std::span<const int> items) {
+    calls.push_back("batch" + std::to_string(items.size()));
+  });
+  auto cb = s.connect([&](int v) { calls.push_back("b" + std::to_string(v)); });
+
+  std::vector<int> items{1, 2};
+  s.fire_batch(items);
+  REQUIRE(calls ==
+          std::vector<std::string>{"a1", "b1", "a2", "b2", "batch2"});
+}
+
+TEST_CASE("signal batch slot", "[signal]") {
+  signal<int> s;
+  std::vector<size_t> batches;
+  std::vector<int> received;
+  auto c = s.connect_batch([&](std::span<const int> items) {
+    batches.push_back(items.size());
+    received.insert(received.end(), items.begin(), items.end());
+  });
+
+  std::vector<int> items{1, 2, 3};
+  s.fire_batch(items);
+  s(4);
+  REQUIRE(batches == std::vector<size_t>{3, 1});
+  REQUIRE(received == std::vector<int>{1, 2, 3, 4});
+}
+
+TEST_CASE("signal disconnect during batch", "[signal]") {
+  signal<int> s;
+  std::vector<int> received;
+  closer c;
+  c = s.connect([&](int v) {
+    received.push_back(v);
+    if (v == 2) c.close();
+  });
+
+  bool connected_during = false;
+  closer late;
+  auto other = s.connect([&](int) {
+    if (!late) {
+      late = s.connect([&](int) { connected_during = true; });
+    }
+  });
+
+  std::vector<int> items{1, 2, 3};
+  s.fire_batch(items);
+  REQUIRE(received == std::vector<int>{1, 2});
+  REQUIRE(!connected_during);
+
+  s(4);
+  REQUIRE(received == std::vector<int>{1, 2});
+  REQUIRE(connected_during);
+}
+
 }  // namespace hula::test
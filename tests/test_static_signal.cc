@@ -0,0 +1,55 @@
+#include <hulaloop/static_signal.h>
+
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+#include <vector>
+
+namespace hula::test {
+
+TEST_CASE("static_signal calls slots in order", "[static_signal]") {
+  std::vector<std::string> calls;
+  auto s = make_static_signal<int>(
+      [&](int v) { calls.push_back("risk " + std::to_string(v)); },
+      [&](int v) { calls.push_back("log " + std::to_string(v)); });
+  static_assert(decltype(s)::size() == 2);
+
+  s(1);
+  REQUIRE(calls == std::vector<std::string>{"risk 1", "log 1"});
+}
+
+TEST_CASE("static_signal passes by const ref", "[static_signal]") {
+  const std::string* seen = nullptr;
+  auto s = make_static_signal<std::string>(
+      [&](const std::string& str) { seen = &str; });
+
+  std::string str = "x";
+  s(str);
+  REQUIRE(seen == &str);
+}
+
+TEST_CASE("static_signal fire batch", "[static_signal]") {
+  struct counter {
+    int sum = 0;
+    void operator()(int v) { sum += v; }
+  };
+
+  static_signal<int, counter, counter> s{counter{}, counter{10}};
+  std::vector<int> items{1, 2, 3};
+  s.fire_batch(items);
+  REQUIRE(s.get<0>().sum == 6);
+  REQUIRE(s.get<1>().sum == 16);
+}
+
+TEST_CASE("static_signal fire batch goes item by item", "[static_signal]") {
+  std::vector<std::string> calls;
+  auto s = make_static_signal<int>(
+      [&](int v) { calls.push_back("risk " + std::to_string(v)); },
+      [&](int v) { calls.push_back("log " + std::to_string(v)); });
+
+  std::vector<int> items{1, 2};
+  s.fire_batch(items);
+  REQUIRE(calls == std::vector<std::string>{"risk 1", "log 1", "risk 2",
+                                            "log 2"});
+}
+
+}  // namespace hula::test
@@ -0,0 +1,131 @@
+#include "fakes.h"
+
+#include <hulaloop/trace.h>
+
+#include <catch2/catch_test_macros.hpp>
+#include <cstring>
+#include <sstream>
+
+namespace hula::test {
+
+namespace {
+size_t count(const std::string& haystack, const std::string& needle) {
+  size_t n = 0;
+  for (auto pos = haystack.find(needle); pos != std::string::npos;
+       pos = haystack.find(needle, pos + 1)) {
+    n++;
+  }
+  return n;
+}
+}  // namespace
+
+TEST_CASE("trace disabled records nothing", "[trace]") {
+  trace::tracer t;
+  {
+    trace::span s("not recorded");
+  }
+
+  std::stringstream ss;
+  t.write_json(ss);
+  REQUIRE(count(ss.str(), "not recorded") == 0);
+}
+
+TEST_CASE("trace user spans", "[trace]") {
+  trace::tracer t;
+  t.install();
+  {
+    trace::span s("decode \"quotes\"", "app", 7);
+  }
+  t.uninstall();
+  {
+    trace::span s("after uninstall");
+  }
+
+  std::stringstream ss;
+  t.write_json(ss);
+  auto json = ss.str();
+  REQUIRE(count(json, "\"name\":\"decode \\\"quotes\\\"\"") == 2);
+  REQUIRE(count(json, "\"ph\":\"B\"") == 1);
+  REQUIRE(count(json, "\"ph\":\"E\"") == 1);
+  REQUIRE(count(json, "\"args\":{\"id\":7}") == 2);
+  REQUIRE(count(json, "after uninstall") == 0);
+
+  // flushing drains the rings
+  std::stringstream again;
+  t.write_json(again);
+  REQUIRE(count(again.str(), "decode") == 0);
+}
+
+TEST_CASE("trace drops when ring is full", "[trace]") {
+  trace::tracer t(4);
+  t.install();
+  for (int i = 0; i < 10; ++i) t.instant("tick", "app");
+  t.uninstall();
+
+  REQUIRE(t.dropped() == 6);
+
+  std::stringstream ss;
+  t.write_json(ss);
+  REQUIRE(count(ss.str(), "\"name\":\"tick\"") == 4);
+}
+
+TEST_CASE_METHOD(fake_clock_loop_test, "trace loop cycle", "[trace]") {
+  trace::tracer t;
+  t.install();
+
+  fd_pair p{};
+  p.reader_slots().readable = [&](int) {};
+  auto c = _loop.add_fd(p.reader_fd(), p.reader_slots(), fd_events::read);
+
+  signal<int> sig;
+  auto sc = sig.connect([](int) {});
+
+  _loop.post([&] { sig(1); });
+
+  auto* msg = "hello";
+  ::write(p.writer_fd(), msg, strlen(msg));
+
+  cycle();
+  t.uninstall();
+
+  std::stringstream ss;
+  t.write_json(ss);
+  auto json = ss.str();
+  REQUIRE(count(json, "\"name\":\"cycle\"") == 2);
+  REQUIRE(count(json, "\"name\":\"poll\"") == 2);
+  REQUIRE(count(json, "\"name\":\"fd_dispatch\"") == 2);
+  REQUIRE(count(json, "\"name\":\"fd\"") == 2);
+  REQUIRE(count(json, "\"name\":\"timers\"") == 2);
+  REQUIRE(count(json, "\"name\":\"timer\"") == 2);
+  REQUIRE(count(json, "\"name\":\"signal\"") == 2);
+}
+
+TEST_CASE("trace alternating tracers reuse the thread's ring", "[trace]") {
+  trace::tracer a;
+  trace::tracer b;
+  for (int i = 0; i < 4; ++i) {
+    a.instant("a", "app");
+    b.instant("b", "app");
+  }
+
+  std::stringstream ss;
+  a.write_json(ss);
+  REQUIRE(count(ss.str(), "\"name\":\"a\"") == 4);
+  REQUIRE(count(ss.str(), "\"tid\":1") == 4);
+  REQUIRE(count(ss.str(), "\"tid\":2") == 0);
+}
+
+TEST_CASE("trace span ends on its tracer after uninstall", "[trace]") {
+  trace::tracer t;
+  t.install();
+  {
+    trace::span s("outlives install");
+    t.uninstall();
+  }
+
+  std::stringstream ss;
+  t.write_json(ss);
+  REQUIRE(count(ss.str(), "\"ph\":\"E\"") == 1);
+}
+
+}  // namespace hula::test
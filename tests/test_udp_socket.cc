@@ -0,0 +1,144 @@
+#include "fakes.h"
+
+#include <hulaloop/udp_socket.h>
+
+#include <catch2/catch_test_macros.hpp>
+
+namespace hula::test {
+
+namespace {
+std::span<const std::byte> as_bytes(const std::string& s) {
+  return std::as_bytes(std::span(s.data(), s.size()));
+}
+
+std::string as_string(std::span<const std::byte> b) {
+  return std::string(reinterpret_cast<const char*>(b.data()), b.size());
+}
+}  // namespace
+
+TEST_CASE_METHOD(loop_test, "udp_socket batched send and receive",
+                 "[udp_socket]") {
+  std::vector<size_t> batches;
+  std::vector<std::string> received;
+  udp_socket rx(_loop, [&](std::span<const datagram> dgrams) {
+    batches.push_back(dgrams.size());
+    for (const auto& d : dgrams) received.push_back(as_string(d.data));
+  });
+  rx.bind("127.0.0.1", 0);
+
+  udp_socket tx(_loop, [](std::span<const datagram>) {});
+  tx.connect("127.0.0.1", rx.port());
+
+  for (int i = 0; i < 10; ++i) tx.send(as_bytes("msg" + std::to_string(i)));
+  REQUIRE(tx.queued() == 10);
+
+  cycle();  // flushed once at the end of the cycle
+  REQUIRE(tx.queued() == 0);
+  REQUIRE(tx.sendmmsg_calls() == 1);
+  REQUIRE(tx.datagrams_sent() == 10);
+
+  cycle();
+  REQUIRE(batches == std::vector<size_t>{10});
+  REQUIRE(received.size() == 10);
+  REQUIRE(received.front() == "msg0");
+  REQUIRE(received.back() == "msg9");
+  REQUIRE(rx.datagrams_received() == 10);
+}
+
+TEST_CASE_METHOD(loop_test, "udp_socket drains several batches per cycle",
+                 "[udp_socket]") {
+  std::vector<size_t> batches;
+  udp_socket rx(
+      _loop,
+      [&](std::span<const datagram> dgrams) {
+        batches.push_back(dgrams.size());
+      },
+      {.batch_size = 4});
+  rx.bind("127.0.0.1", 0);
+
+  udp_socket tx(_loop, [](std::span<const datagram>) {});
+  tx.bind("127.0.0.1", 0);
+  auto to = net::address::parse("127.0.0.1", rx.port());
+  for (int i = 0; i < 10; ++i) tx.send(as_bytes("x"), to);
+  tx.flush();
+  REQUIRE(tx.queued() == 0);
+
+  cycle();
+  REQUIRE(batches == std::vector<size_t>{4, 4, 2});
+}
+
+TEST_CASE_METHOD(loop_test, "udp_socket reply to sender", "[udp_socket]") {
+  std::string reply;
+  udp_socket client(_loop, [&](std::span<const datagram> dgrams) {
+    reply = as_string(dgrams.front().data);
+  });
+
+  udp_socket<>* server_ptr = nullptr;
+  udp_socket server(_loop, [&](std::span<const datagram> dgrams) {
+    for (const auto& d : dgrams) {
+      net::address from{.storage = *d.from, .len = d.from_len};
+      server_ptr->send(d.data, from);
+    }
+  });
+  server_ptr = &server;
+  server.bind("127.0.0.1", 0);
+
+  client.connect("127.0.0.1", server.port());
+  client.send(as_bytes("ping"));
+
+  for (int i = 0; i < 3 && reply.empty(); ++i) cycle();
+  REQUIRE(reply == "ping");
+}
+
+TEST_CASE_METHOD(loop_test, "udp_socket segmented send", "[udp_socket]") {
+  std::vector<size_t> sizes;
+  udp_socket rx(_loop, [&](std::span<const datagram> dgrams) {
+    for (const auto& d : dgrams) sizes.push_back(d.data.size());
+  });
+  rx.bind("127.0.0.1", 0);
+
+  udp_socket tx(_loop, [](std::span<const datagram>) {});
+  tx.bind("127.0.0.1", 0);
+
+  std::string payload(2500, 'a');
+  tx.send_segmented(as_bytes(payload), 1000,
+                    net::address::parse("127.0.0.1", rx.port()));
+  tx.flush();
+
+  if (tx.send_errors() > 0) {
+    WARN("UDP_SEGMENT not supported");
+    return;
+  }
+
+  cycle();
+  REQUIRE(sizes == std::vector<size_t>{1000, 1000, 500});
+}
+
+TEST_CASE_METHOD(loop_test, "udp_socket rx timestamps", "[udp_socket]") {
+  std::vector<std::optional<net::kernel_time>> times;
+  udp_socket rx(
+      _loop,
+      [&](std::span<const datagram> dgrams) {
+        for (const auto& d : dgrams) times.push_back(d.kernel_time);
+      },
+      {.timestamps = true});
+  rx.bind("127.0.0.1", 0);
+
+  udp_socket tx(_loop, [](std::span<const datagram>) {});
+  tx.connect("127.0.0.1", rx.port());
+
+  auto before = std::chrono::system_clock::now();
+  tx.send(as_bytes("a"));
+  tx.send(as_bytes("b"));
+  for (int i = 0; i < 100 && times.size() < 2; ++i) cycle();
+
+  REQUIRE(times.size() == 2);
+  for (const auto& t : times) {
+    REQUIRE(t.has_value());
+    REQUIRE(*t >= before - 1s);
+    REQUIRE(*t <= std::chrono::system_clock::now());
+  }
+  REQUIRE(_loop.rx_delay().count() == 2);
+}
+
+}  // namespace hula::test
@@ -0,0 +1,95 @@
+#include "fakes.h"
+
+#include <hulaloop/watchdog.h>
+
+#include <catch2/catch_test_macros.hpp>
+#include <cstring>
+
+namespace hula::test {
+
+namespace {
+// the watchdog thread and the heartbeat use the real clock. stalls last ten
+// thresholds and the threshold is far above scheduling noise, so a loaded
+// machine neither misses a stall nor reports one which didn't happen.
+constexpr auto k_threshold = 50ms;
+constexpr auto k_stall = 10 * k_threshold;
+}  // namespace
+
+TEST_CASE_METHOD(loop_test, "watchdog no stalls", "[watchdog]") {
+  watchdog w(_loop, k_threshold);
+  w.start();
+
+  _loop.post([] {});
+  cycle();
+  std::this_thread::sleep_for(k_stall);  // idle time is never a stall
+
+  w.stop();
+  REQUIRE(w.stalls().empty());
+}
+
+TEST_CASE_METHOD(loop_test, "watchdog attributes stalled timer", "[watchdog]") {
+  watchdog w(_loop, k_threshold);
+
+  int slot_calls = 0;
+  w.set_stall_slot([&](const stall_event&) { slot_calls++; });
+  w.start();
+
+  auto id = _loop.post([&] {
+    _loop.annotate("slow callback");
+    std::this_thread::sleep_for(k_stall);
+  });
+  cycle();
+  // let the watchdog see the stall end
+  std::this_thread::sleep_for(k_threshold);
+
+  w.stop();
+  auto stalls = w.stalls();
+  REQUIRE(stalls.size() == 1);
+  REQUIRE(slot_calls == 1);
+  REQUIRE(stalls[0].phase == loop_phase::timers);
+  REQUIRE(stalls[0].id == static_cast<int64_t>(id));
+  REQUIRE(std::strcmp(stalls[0].label, "slow callback") == 0);
+  REQUIRE(stalls[0].duration >= k_stall);
+  REQUIRE(stalls[0].backtrace.empty());
+}
+
+TEST_CASE_METHOD(loop_test, "watchdog attributes stalled fd", "[watchdog]") {
+  fd_pair p{};
+  p.reader_slots().readable = [&](int) {
+    std::this_thread::sleep_for(k_stall);
+  };
+  auto c = _loop.add_fd(p.reader_fd(), p.reader_slots(), fd_events::read);
+
+  auto* msg = "hello";
+  ::write(p.writer_fd(), msg, strlen(msg));
+
+  watchdog w(_loop, k_threshold);
+  w.start();
+  cycle();
+  w.stop();
+
+  auto stalls = w.stalls();
+  REQUIRE(stalls.size() == 1);
+  REQUIRE(stalls[0].phase == loop_phase::fd_dispatch);
+  REQUIRE(stalls[0].id == p.reader_fd());
+}
+
+TEST_CASE_METHOD(loop_test, "watchdog captures backtrace", "[watchdog]") {
+  watchdog w(_loop, k_threshold);
+  w.enable_backtraces(unix::sig::sigprof);
+  w.start();
+
+  _loop.post([&] {
+    auto until = std::chrono::steady_clock::now() + k_stall;
+    while (std::chrono::steady_clock::now() < until) {
+    }
+  });
+  cycle();
+  w.stop();
+
+  auto stalls = w.stalls();
+  REQUIRE(stalls.size() == 1);
+  REQUIRE(!stalls[0].backtrace.empty());
+}
+
+}  // namespace hula::test